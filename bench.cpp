@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "utils/LogFormat.h"
+#include "utils/LogRecordPool.h"
+#include "utils/LogSpan.h"
+#include "utils/StringUtils.h"
+#include "utils/log.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double ElapsedMs(const BenchClock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+/******************************************* sort *************************************************/
+
+struct sortbyalphanumeric
+{
+    bool operator()(const std::wstring& left, const std::wstring& right)
+    {
+        return StringUtils::AlphaNumericCompare(left.c_str(), right.c_str()) < 0;
+    }
+};
+
+// file names like "Episode 12 - Part 3 (take 007).mkv", the kind of list natural sorting is for
+static std::string MakeName(int i)
+{
+    static const char* const words[] = { "Episode", "track", "IMG_", "Season", "disc", "Part" };
+    return StringUtils::Format("%s %d - %s %d (take %03d).mkv", words[i % 6], rand() % 5000,
+                               words[(i / 6) % 6], rand() % 100, rand() % 1000);
+}
+
+static int BenchSort(int count, unsigned int threads)
+{
+    srand(1);
+    std::vector<std::string> names;
+    std::vector<std::wstring> wnames;
+    for (int i = 0; i < count; ++i)
+    {
+        names.push_back(MakeName(i));
+        wnames.push_back(std::wstring(names.back().begin(), names.back().end()));
+    }
+    printf("sorting %d names\n", count);
+
+    std::vector<std::string> work(names);
+    BenchClock::time_point start = BenchClock::now();
+    std::sort(work.begin(), work.end(), sortstringbyname());
+    printf("  std::sort + sortstringbyname (no natural order): %8.1f ms\n", ElapsedMs(start));
+
+    std::vector<std::wstring> wwork(wnames);
+    start = BenchClock::now();
+    std::sort(wwork.begin(), wwork.end(), sortbyalphanumeric());
+    printf("  std::sort + AlphaNumericCompare:                 %8.1f ms\n", ElapsedMs(start));
+
+    start = BenchClock::now();
+    std::vector<std::string> keys;
+    keys.reserve(wnames.size());
+    for (size_t i = 0; i < wnames.size(); ++i)
+        keys.push_back(StringUtils::AlphaNumericSortKey(wnames[i].c_str()));
+    std::sort(keys.begin(), keys.end());
+    printf("  AlphaNumericSortKey + std::sort (keys only):     %8.1f ms\n", ElapsedMs(start));
+
+    wwork = wnames;
+    start = BenchClock::now();
+    StringUtils::SortAlphaNumeric(wwork, 1);
+    printf("  SortAlphaNumeric, 1 thread:                      %8.1f ms\n", ElapsedMs(start));
+
+    wwork = wnames;
+    start = BenchClock::now();
+    StringUtils::SortAlphaNumeric(wwork, threads);
+    printf("  SortAlphaNumeric, %u threads (0 = all cores):     %8.1f ms\n", threads, ElapsedMs(start));
+
+    for (size_t i = 1; i < wwork.size(); ++i)
+    {
+        if (StringUtils::AlphaNumericCompare(wwork[i - 1].c_str(), wwork[i].c_str()) > 0)
+        {
+            printf("  ERROR: result is not in AlphaNumericCompare order at %d\n", (int)i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/******************************************* memdump **********************************************/
+
+static int BenchMemDump(size_t bytes, const char* logDir)
+{
+    if (!CLog::Init(logDir, "bench"))
+    {
+        printf("can't open log file in %s\n", logDir);
+        return 1;
+    }
+    CLog::SetLogLevel(LOG_LEVEL_DEBUG);
+
+    std::vector<char> data(bytes);
+    for (size_t i = 0; i < bytes; ++i)
+        data[i] = (char)rand();
+    printf("dumping %llu bytes to %s/bench.log\n", (unsigned long long)bytes, logDir);
+
+    BenchClock::time_point start = BenchClock::now();
+    CLog::MemDump(data.data(), (int)bytes);
+    printf("  MemDump, 16 bytes per row:                       %8.1f ms\n", ElapsedMs(start));
+
+    start = BenchClock::now();
+    CLog::MemDump(data.data(), bytes, 32, 0, bytes / 2);
+    printf("  MemDump, 32 bytes per row, first half:           %8.1f ms\n", ElapsedMs(start));
+
+    CLog::Close();
+    return 0;
+}
+
+/******************************************* durability *******************************************/
+
+static int BenchDurability(int count, const char* logDir)
+{
+    static const struct { int mode; int syncLevel; const char* name; } modes[] =
+    {
+        { LOG_DURABILITY_FLUSH,    LOGNONE,   "fflush per record:                      " },
+        { LOG_DURABILITY_BUFFERED, LOGNONE,   "buffered:                               " },
+        { LOG_DURABILITY_PERIODIC, LOGNONE,   "buffered, fdatasync every 100 ms:       " },
+        { LOG_DURABILITY_BUFFERED, LOGSEVERE, "buffered, fdatasync SEVERE (1 in 1000): " },
+        { LOG_DURABILITY_FLUSH,    LOGDEBUG,  "fdatasync per record:                   " },
+    };
+    printf("logging %d records to %s/bench.log\n", count, logDir);
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m)
+    {
+        // fdatasync per record is slow, do fewer of those
+        const int records = modes[m].syncLevel == LOGDEBUG ? count / 100 : count;
+        CLog::SetDurability(modes[m].mode, 100, modes[m].syncLevel);
+        if (!CLog::Init(logDir, "bench"))
+        {
+            printf("can't open log file in %s\n", logDir);
+            return 1;
+        }
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < records; ++i)
+            CLog::Log(i % 1000 == 999 ? LOGSEVERE : LOGINFO, "record %d of the durability benchmark, some text to make it typical", i);
+        const double ms = ElapsedMs(start);
+        CLog::Close();
+        printf("  %s %8.1f ms, %8.0f records/s\n", modes[m].name, ms, records * 1000.0 / ms);
+    }
+    CLog::SetDurability(LOG_DURABILITY_FLUSH);
+    return 0;
+}
+
+/******************************************* span *************************************************/
+
+static volatile int g_spanWork;
+
+static void SpanWork(int i, int level, unsigned int threshold)
+{
+    CLogSpan span(level, "work", threshold);
+    g_spanWork += i;
+}
+
+static void PlainWork(int i)
+{
+    g_spanWork += i;
+}
+
+static int BenchSpan(int count, const char* logDir)
+{
+    if (!CLog::Init(logDir, "bench"))
+    {
+        printf("can't open log file in %s\n", logDir);
+        return 1;
+    }
+    CLog::SetLogLevel(LOG_LEVEL_NORMAL);
+    printf("%d spans\n", count);
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        PlainWork(i);
+    const double plain = ElapsedMs(start);
+    printf("  no span:                                 %8.2f ns per call\n", plain * 1e6 / count);
+
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        SpanWork(i, LOGDEBUG, 0);
+    printf("  LOGDEBUG span, not logged:               %8.2f ns per call\n", ElapsedMs(start) * 1e6 / count);
+
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        SpanWork(i, LOGWARNING, 1000000);
+    printf("  LOGWARNING span, below the threshold:    %8.2f ns per call\n", ElapsedMs(start) * 1e6 / count);
+
+    CLogSpan::StartTrace(count);
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        SpanWork(i, LOGDEBUG, 0);
+    printf("  LOGDEBUG span, traced:                   %8.2f ns per call\n", ElapsedMs(start) * 1e6 / count);
+    const std::string trace = std::string(logDir) + "/bench.trace.json";
+    if (!CLogSpan::StopTrace(trace.c_str()))
+        printf("can't write %s\n", trace.c_str());
+
+    CLog::Close();
+    return 0;
+}
+
+/******************************************* pool *************************************************/
+
+// every heap allocation of the process, malloc() is interposed where the C library allows it
+static std::atomic<unsigned long long> g_mallocs(0);
+
+#if defined(__GLIBC__)
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* p, size_t size);
+
+    void* malloc(size_t size)
+    {
+        g_mallocs.fetch_add(1, std::memory_order_relaxed);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        g_mallocs.fetch_add(1, std::memory_order_relaxed);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size)
+    {
+        g_mallocs.fetch_add(1, std::memory_order_relaxed);
+        return __libc_realloc(p, size);
+    }
+}
+#define HAS_MALLOC_COUNT
+#endif
+
+// short records mostly, some that need the larger size classes
+static void LogPoolRecord(int i)
+{
+    static const std::string medium(600, 'm');
+    static const std::string large(3000, 'l');
+    if (i % 100 == 99)
+        CLog::Log(LOGNOTICE, "record %d with a long text: %s", i, large.c_str());
+    else if (i % 10 == 9)
+        CLog::Log(LOGNOTICE, "record %d with some text: %s", i, medium.c_str());
+    else
+        CLog::Log(LOGNOTICE, "record %d of the pool benchmark, value %.3f", i, i * 0.5);
+}
+
+static int BenchPool(int count, const char* logDir)
+{
+#ifndef HAS_MALLOC_COUNT
+    printf("malloc() can't be counted with this C library\n");
+#endif
+    if (!CLog::Init(logDir, "bench"))
+    {
+        printf("can't open log file in %s\n", logDir);
+        return 1;
+    }
+    CLog::SetLogLevel(LOG_LEVEL_NORMAL);
+    printf("logging %d records to %s/bench.log\n", count, logDir);
+
+    // the pool and the log buffers fill up first
+    for (int i = 0; i < 1000; i++)
+        LogPoolRecord(i);
+
+    unsigned long long mallocs = g_mallocs.load();
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+    {
+        const std::string text = StringUtils::Format("record %d of the pool benchmark, value %.3f", i, i * 0.5);
+        g_spanWork += (int)text.size();
+    }
+    printf("  StringUtils::Format alone:               %8.2f ns, %6.2f mallocs per record\n",
+           ElapsedMs(start) * 1e6 / count, (double)(g_mallocs.load() - mallocs) / count);
+
+    mallocs = g_mallocs.load();
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        LogPoolRecord(i);
+    printf("  CLog::Log, pooled record buffers:        %8.2f ns, %6.2f mallocs per record\n",
+           ElapsedMs(start) * 1e6 / count, (double)(g_mallocs.load() - mallocs) / count);
+
+    CLogRecordPoolStats stats;
+    CLogRecordPool::GetStats(stats);
+    printf("  pool: %llu buffers in use, high water %llu, %llu bytes in slabs, %llu heap fallbacks\n",
+           stats.inUse, stats.highWater, stats.slabBytes, stats.fallbacks);
+    CLog::Close();
+    return 0;
+}
+
+/******************************************* format ***********************************************/
+
+static int BenchFormat(int count)
+{
+    printf("formatting %d messages\n", count);
+    static const CLogFormatProgram integers("%s: %d items, %zu bytes, id %llu");
+    static const CLogFormatProgram mixed("record %d of %s, value %.3f");
+    CStringBuilder out;
+    size_t total = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        total += StringUtils::Format("%s: %d items, %zu bytes, id %llu", "queue", i, (size_t)i * 64, 1000000ULL + i).size();
+    printf("  integers, StringUtils::Format:           %8.2f ns per message\n", ElapsedMs(start) * 1e6 / count);
+
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+    {
+        out.Clear();
+        integers.Format(out, "queue", i, (size_t)i * 64, 1000000ULL + i);
+        total += out.Size();
+    }
+    printf("  integers, CLogFormatProgram:             %8.2f ns per message\n", ElapsedMs(start) * 1e6 / count);
+
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        total += StringUtils::Format("record %d of %s, value %.3f", i, "bench", i * 0.5).size();
+    printf("  with a double, StringUtils::Format:      %8.2f ns per message\n", ElapsedMs(start) * 1e6 / count);
+
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+    {
+        out.Clear();
+        mixed.Format(out, i, "bench", i * 0.5);
+        total += out.Size();
+    }
+    printf("  with a double, CLogFormatProgram:        %8.2f ns per message\n", ElapsedMs(start) * 1e6 / count);
+    g_spanWork += (int)total;
+    return 0;
+}
+
+/******************************************* lazy *************************************************/
+
+// stands for a Dump() kind of argument, too expensive to build for a record that isn't written
+static std::string ExpensiveText(int i)
+{
+    return StringUtils::Format("state of item %d: %s", i, std::string(64, 'x').c_str());
+}
+
+static int BenchLazy(int count)
+{
+    CLog::SetLogLevel(LOG_LEVEL_NORMAL);
+    printf("%d LOGDEBUG calls below the log level\n", count);
+
+    // what log_debug() expanded to before it checked the level
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        CLog::Log(LOGDEBUG, "[%04d]%s", __LINE__, ExpensiveText(i).c_str());
+    printf("  CLog::Log, argument evaluated:           %8.2f ns per call\n", ElapsedMs(start) * 1e6 / count);
+
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        log_debug("%s", ExpensiveText(i).c_str());
+    printf("  log_debug:                               %8.2f ns per call\n", ElapsedMs(start) * 1e6 / count);
+
+    start = BenchClock::now();
+    for (int i = 0; i < count; i++)
+        CLog::LogLazy(LOGDEBUG, [&] { return ExpensiveText(i); });
+    printf("  CLog::LogLazy:                           %8.2f ns per call\n", ElapsedMs(start) * 1e6 / count);
+    return 0;
+}
+
+/******************************************* main *************************************************/
+
+static void Usage()
+{
+    printf("usage: bench <name> [args]\n");
+    printf("  sort [count=1000000] [threads=0]   natural order sorting\n");
+    printf("  memdump [bytes=1048576] [logdir=.] hex dump into the log\n");
+    printf("  durability [records=200000] [logdir=.] log throughput per durability mode\n");
+    printf("  span [count=10000000] [logdir=.]   CLogSpan overhead, writes logdir/bench.trace.json\n");
+    printf("  pool [count=1000000] [logdir=.]    heap allocations per record, record buffer pool usage\n");
+    printf("  format [count=1000000]             CLogFormatProgram against StringUtils::Format\n");
+    printf("  lazy [count=1000000]               cost of a filtered log_debug() with an expensive argument\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        Usage();
+        return 1;
+    }
+
+    std::string name(argv[1]);
+    if (name == "sort")
+        return BenchSort(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 0);
+    if (name == "memdump")
+        return BenchMemDump(argc > 2 ? (size_t)atol(argv[2]) : 1048576, argc > 3 ? argv[3] : ".");
+    if (name == "durability")
+        return BenchDurability(argc > 2 ? atoi(argv[2]) : 200000, argc > 3 ? argv[3] : ".");
+    if (name == "span")
+        return BenchSpan(argc > 2 ? atoi(argv[2]) : 10000000, argc > 3 ? argv[3] : ".");
+    if (name == "format")
+        return BenchFormat(argc > 2 ? atoi(argv[2]) : 1000000);
+    if (name == "lazy")
+        return BenchLazy(argc > 2 ? atoi(argv[2]) : 1000000);
+    if (name == "pool")
+        return BenchPool(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? argv[3] : ".");
+
+    Usage();
+    return 1;
+}
@@ -3,6 +3,11 @@
 #include <Windows.h>
 #endif
 #include "log.h"
+#include <stdlib.h>
+#include <chrono>
+
+// an extra log level, for records of a subsystem that can be turned on separately
+#define LOGEXTRA_DEMO (1 << LOGMASKBIT)
 
 
 #ifdef WIN32
@@ -42,8 +47,10 @@ static std::string UTF8ToGBK(const char* strUTF8)
 
 int DoWork()
 {
+#ifdef WIN32
 	log_info("%s", GBKToUTF8("дĲ").c_str());
 	log_info("%s", GBKToUTF8("123abccдĲ").c_str());
+#endif
     log_debug("this is first line log");
     log_debug("this is first line log");
     log_notice("this is notice line log");
@@ -53,6 +60,8 @@ int DoWork()
     log_error("this is error log msg");
     log_severe("this is severe log msg");
     log_fatal("fatal msg, app crash");
+    // the level is written without the extra bit, a binary log must still decode (clog-decode)
+    CLog::Log(LOGEXTRA_DEMO | LOGNOTICE, "this is extra level log msg %d", 1);
 
     char refdata[] = "0123456789abcdefghijklmnopqrstuvwxyz";
     CLog::MemDump(refdata, sizeof(refdata));
@@ -61,14 +70,20 @@ int DoWork()
 }
 
 
+static int g_iterations = 1;
+
 int SingleThread()
 {
-    return DoWork();
+    for (int i = 0; i < g_iterations; ++i)
+        DoWork();
+    return 0;
 }
 
 void* CalcThread(void *pParam)
 {
-    DoWork();
+    CLog::SetThreadName("calc");
+    for (int i = 0; i < g_iterations; ++i)
+        DoWork();
     return 0;
 }
 
@@ -138,7 +153,10 @@ int main(int argc, char* argv[])
 {
     std::string path(argv[1]);
 #ifndef DISABLE_LOGGING
-    CLog::Init(path.c_str(), "TEST");
+    // "binary" as 4th argument writes TEST.clog, read it with tools/clog-decode
+    const bool binary = argc > 4 && std::string(argv[4]) == "binary";
+    CLog::Init(path.c_str(), "TEST", binary ? LOG_FORMAT_BINARY : LOG_FORMAT_TEXT);
+    CLog::SetExtraLogLevels(LOGEXTRA_DEMO);
 #ifdef NDEBUG
     CLog::SetLogLevel(LOG_LEVEL_NORMAL);
 #else
@@ -147,7 +165,16 @@ int main(int argc, char* argv[])
 #endif
 
     int cnt = atoi(argv[2]);
+    if (argc > 3)
+        g_iterations = atoi(argv[3]);
+
+    // with several threads and many iterations this measures the contended log path
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     VadCheck(cnt);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    int threads = cnt > 1 ? cnt : 1;
+    printf("%d thread(s) x %d iteration(s): %.1f ms, %.0f DoWork() calls/s\n",
+           threads, g_iterations, ms, threads * (double)g_iterations * 1000.0 / ms);
 
     CLog::Close();
 
@@ -0,0 +1,293 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utils/ShmInterfaceForCLog.h"
+
+/*
+ * clog-agent: write the shared memory ring of a process logging with
+ * CShmInterfaceForCLog (built with LOG_SHM_RING) to its log file. The agent
+ * rotates the file the way CLog::Init() does, optionally gzips the rotated one,
+ * and keeps writing until the process closes the log or exits, then waits
+ * for the next ring of the same name (unless --once is given).
+ */
+
+extern char** environ;
+
+static volatile sig_atomic_t s_stop = 0;
+
+static void OnSignal(int)
+{
+    s_stop = 1;
+}
+
+static long long NowMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void SleepMs(unsigned int ms)
+{
+    struct timespec delay;
+    delay.tv_sec = ms / 1000;
+    delay.tv_nsec = (long)(ms % 1000) * 1000000;
+    nanosleep(&delay, NULL);
+}
+
+static bool WriteAll(int fd, const char* data, size_t length)
+{
+    while (length)
+    {
+        const ssize_t written = write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+static void Compress(const char* path)
+{
+    char* const argv[] = { (char*)"gzip", (char*)"-f", (char*)path, NULL };
+    pid_t pid;
+    const int error = posix_spawnp(&pid, "gzip", NULL, NULL, argv, environ);
+    if (error != 0)
+        fprintf(stderr, "clog-agent: can't run gzip: %s\n", strerror(error));
+}
+
+struct CRing
+{
+    int fd;                    // kept open while mapped, pins the object after it is unlinked
+    dev_t device;
+    ino_t inode;
+    CShmLogRingHeader* header;
+    size_t size;
+};
+
+// a ring of the name that is ready to be written and isn't the one just finished
+static bool OpenRing(const std::string& name, const CRing& finished, CRing& ring)
+{
+    ring.fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (ring.fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(ring.fd, &st) != 0 || (finished.fd >= 0 && st.st_dev == finished.device && st.st_ino == finished.inode) ||
+        st.st_size < (off_t)sizeof(CShmLogRingHeader))
+    {
+        close(ring.fd);
+        return false;
+    }
+    void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring.fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        close(ring.fd);
+        return false;
+    }
+    ring.device = st.st_dev;
+    ring.inode = st.st_ino;
+    ring.header = (CShmLogRingHeader*)mapped;
+    ring.size = (size_t)st.st_size;
+    CShmLogRingHeader* header = ring.header;
+    if (header->state.load(std::memory_order_acquire) == CShmLogRingHeader::STATE_INITIALIZING ||
+        memcmp(header->magic, "CLOGSHM\1", 8) != 0 || header->headerSize < sizeof(CShmLogRingHeader) ||
+        header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+        header->headerSize + header->capacity > ring.size)
+    {
+        munmap(mapped, ring.size);
+        close(ring.fd);
+        return false;
+    }
+    return true;
+}
+
+// writes the ring until it is closed or its writer is gone, false on errors
+static bool DrainRing(const std::string& name, CRing& ring, bool compress)
+{
+    CShmLogRingHeader* header = ring.header;
+    const int32_t self = (int32_t)getpid();
+    int32_t agent = 0;
+    while (!header->agentPid.compare_exchange_strong(agent, self))
+    {
+        if (CShmInterfaceForCLog::IsAlive(agent))
+        {
+            fprintf(stderr, "clog-agent: ring %s is already written by process %d\n", header->logFile, (int)agent);
+            return false;
+        }
+    }
+
+    // a fresh ring starts a new file; one an earlier agent started writing is continued
+    const char* logFile = header->logFile;
+    int flags = O_WRONLY | O_CREAT | O_APPEND;
+    if (header->tail.load(std::memory_order_acquire) == 0)
+    {
+        (void)remove(header->oldLogFile);
+        if (rename(logFile, header->oldLogFile) == 0 && compress)
+            Compress(header->oldLogFile);
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    }
+    const int fd = open(logFile, flags, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "clog-agent: can't open %s: %s\n", logFile, strerror(errno));
+        header->agentPid.store(0);
+        return false;
+    }
+
+    const char* data = CShmInterfaceForCLog::GetRingData(header);
+    const uint64_t capacity = header->capacity;
+    uint64_t tail = header->tail.load(std::memory_order_acquire);
+    uint64_t synced = tail;
+    long long lastSync = NowMs();
+    bool ok = true;
+    for (;;)
+    {
+        const uint64_t head = header->head.load(std::memory_order_acquire);
+        if (head != tail)
+        {
+            // [tail, head) in at most two pieces, the ring wraps once
+            const uint64_t offset = tail & (capacity - 1);
+            const uint64_t first = head - tail < capacity - offset ? head - tail : capacity - offset;
+            if (!WriteAll(fd, data + offset, (size_t)first) || !WriteAll(fd, data, (size_t)(head - tail - first)))
+            {
+                fprintf(stderr, "clog-agent: can't write %s: %s\n", logFile, strerror(errno));
+                ok = false;
+                break;
+            }
+            tail = head;
+            header->tail.store(tail, std::memory_order_seq_cst);
+            if (header->writerWaiting.load(std::memory_order_seq_cst) && header->writerWaiting.exchange(0))
+                CShmInterfaceForCLog::Wake(header->writerWaiting);
+        }
+
+        const unsigned int syncPeriodMs = header->syncPeriodMs;
+        const uint64_t syncRequest = header->syncRequest.load(std::memory_order_relaxed);
+        if (synced != tail && ((syncRequest > synced && syncRequest <= tail) ||
+                               (syncPeriodMs && NowMs() - lastSync >= syncPeriodMs)))
+        {
+            fdatasync(fd);
+            synced = tail;
+            lastSync = NowMs();
+        }
+        if (head != tail)
+            continue;
+
+        if (header->state.load(std::memory_order_acquire) == CShmLogRingHeader::STATE_CLOSED ||
+            !CShmInterfaceForCLog::IsAlive(header->writerPid) || s_stop)
+        {
+            if (header->head.load(std::memory_order_acquire) == tail) // nothing came in meanwhile
+                break;
+            continue;
+        }
+        // the writer wakes us after publishing a record if it sees the flag
+        header->agentWaiting.store(1, std::memory_order_seq_cst);
+        if (header->head.load(std::memory_order_seq_cst) == tail)
+            CShmInterfaceForCLog::Wait(header->agentWaiting, 1, 100);
+        header->agentWaiting.store(0, std::memory_order_relaxed);
+    }
+
+    if (synced != tail)
+        fdatasync(fd);
+    close(fd);
+    const unsigned long long dropped = header->dropped.load();
+    if (dropped)
+        fprintf(stderr, "clog-agent: %llu records for %s were dropped without an agent\n", dropped, logFile);
+    header->agentPid.store(0);
+
+    // a crashed writer left the name behind, remove it unless a new ring replaced it already
+    struct stat st;
+    const int current = ok && header->state.load() != CShmLogRingHeader::STATE_CLOSED ? shm_open(name.c_str(), O_RDONLY, 0) : -1;
+    if (current >= 0)
+    {
+        if (fstat(current, &st) == 0 && st.st_dev == ring.device && st.st_ino == ring.inode)
+            (void)shm_unlink(name.c_str());
+        close(current);
+    }
+    return ok;
+}
+
+static bool IsOption(const char* arg, const char* shortName, const char* longName)
+{
+    return strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0;
+}
+
+static void Usage()
+{
+    printf("usage: clog-agent [-z|--compress] [--once] <name.log>\n");
+    printf("  writes the log of the process logging to name.log through shared memory,\n");
+    printf("  name.log as the process opened it, a relative path from the same directory\n");
+    printf("  -z gzips the rotated name.old.log, --once exits after one process closed the log\n");
+}
+
+int main(int argc, char* argv[])
+{
+    bool compress = false;
+    bool once = false;
+    const char* logFile = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (IsOption(argv[i], "-z", "--compress"))
+            compress = true;
+        else if (strcmp(argv[i], "--once") == 0)
+            once = true;
+        else if (argv[i][0] != '-' && !logFile)
+            logFile = argv[i];
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+    if (!logFile)
+    {
+        Usage();
+        return 1;
+    }
+
+    // no SA_RESTART, the futex wait returns on a signal
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = OnSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGCHLD, SIG_IGN); // gzip children are reaped by the kernel
+    signal(SIGPIPE, SIG_IGN);
+
+    const std::string name = CShmInterfaceForCLog::GetRingName(logFile);
+    CRing finished;
+    finished.fd = -1;
+    while (!s_stop)
+    {
+        CRing ring;
+        if (!OpenRing(name, finished, ring))
+        {
+            SleepMs(100);
+            continue;
+        }
+        const bool ok = DrainRing(name, ring, compress);
+        munmap(ring.header, ring.size);
+        if (finished.fd >= 0)
+            close(finished.fd);
+        finished = ring;
+        if (!ok)
+            return 1;
+        if (once)
+            break;
+    }
+    if (finished.fd >= 0)
+        close(finished.fd);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "utils/BinaryLog.h"
+
+/*
+ * clog-decode: turn a binary log (CLog::Init(..., LOG_FORMAT_BINARY)) back into
+ * exactly the text log the same calls would have written.
+ */
+
+static bool ReadFile(const char* path, std::string& data)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+    char buffer[65536];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.append(buffer, count);
+    const bool ok = ferror(file) == 0;
+    fclose(file);
+    return ok;
+}
+
+static void Usage()
+{
+    printf("usage: clog-decode [--no-bom] <file.clog> [out.log]\n");
+    printf("  writes the text log to out.log or stdout, with the BOM the text log starts with\n");
+    printf("  unless --no-bom is given\n");
+}
+
+int main(int argc, char* argv[])
+{
+    bool bom = true;
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--no-bom") == 0)
+    {
+        bom = false;
+        arg++;
+    }
+    if (arg >= argc || argc - arg > 2)
+    {
+        Usage();
+        return 1;
+    }
+
+    const char* inPath = argv[arg];
+    std::string data;
+    if (!ReadFile(inPath, data))
+    {
+        fprintf(stderr, "clog-decode: can't read %s\n", inPath);
+        return 1;
+    }
+
+    CBinaryLogReader reader;
+    if (!reader.Open(data.data(), data.size()))
+    {
+        fprintf(stderr, "clog-decode: %s is not a binary log\n", inPath);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (arg + 1 < argc)
+    {
+        out = fopen(argv[arg + 1], "wb");
+        if (!out)
+        {
+            fprintf(stderr, "clog-decode: can't create %s\n", argv[arg + 1]);
+            return 1;
+        }
+    }
+
+    if (bom)
+    {
+        static const unsigned char BOM[3] = { 0xEF, 0xBB, 0xBF };
+        fwrite(BOM, sizeof(BOM), 1, out);
+    }
+
+    std::string record;
+    unsigned long long records = 0;
+    while (reader.NextRecord(record))
+    {
+        record.push_back('\n');
+        fwrite(record.data(), record.size(), 1, out);
+        records++;
+    }
+
+    int result = 0;
+    if (!reader.IsAtEnd())
+    {
+        // the writer was most likely killed in the middle of a record
+        fprintf(stderr, "clog-decode: %s: stopped at byte %llu of %llu after %llu records, the rest is cut short or damaged\n",
+                inPath, (unsigned long long)reader.GetPosition(), (unsigned long long)data.size(), records);
+        result = 2;
+    }
+    if (ferror(out))
+    {
+        fprintf(stderr, "clog-decode: write error\n");
+        result = 1;
+    }
+    if (out != stdout)
+        fclose(out);
+    return result;
+}
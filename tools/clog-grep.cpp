@@ -0,0 +1,793 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "utils/KeywordMatcher.h"
+#include "utils/LogIndex.h"
+#include "utils/StringUtils.h"
+
+#ifdef WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__gnu_linux__) || defined(__ANDROID__)
+#include <poll.h>
+#include <sys/inotify.h>
+#define HAS_FOLLOW 1
+#endif
+
+/*
+ * clog-grep: filter the records of text logs by time, level, thread and keywords.
+ *
+ * The log is mapped into memory and cut into chunks at record boundaries, the
+ * chunks are searched by a pool of threads and the matches written out in file
+ * order. A record is its header line,
+ *   "YYYY-MM-DD HH:MM:SS T:<thread index>[ <thread name>] <level right aligned in 7>: <text>"
+ * plus the continuation lines after it, which start with 44 spaces.
+ */
+
+static const size_t chunkSize = 8 * 1024 * 1024;
+static const size_t timestampLength = 19; // "YYYY-MM-DD HH:MM:SS"
+static const char continuation[] = "                                            "; // see CLog::FormatRecord
+static const size_t continuationLength = sizeof(continuation) - 1;
+static const char* const levelNames[] = { "DEBUG", "INFO", "NOTICE", "WARNING", "ERROR", "SEVERE", "FATAL", "NONE" };
+static const int levelCount = sizeof(levelNames) / sizeof(levelNames[0]);
+
+/******************************************* mapped file *************************************************/
+
+class CMappedFile
+{
+public:
+    CMappedFile() : m_data(NULL), m_size(0)
+#ifdef WIN32
+        , m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+    {}
+    ~CMappedFile() { Close(); }
+
+    bool Open(const char* path)
+    {
+#ifdef WIN32
+        m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size))
+            return false;
+        m_size = (size_t)size.QuadPart;
+        if (m_size == 0)
+            return true;
+        m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!m_mapping)
+            return false;
+        m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        return m_data != NULL;
+#else
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            return false;
+        }
+        m_size = (size_t)st.st_size;
+        if (m_size != 0)
+        {
+            void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                m_data = (const char*)data;
+                (void)madvise(data, m_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+            }
+        }
+        close(fd);
+        return m_size == 0 || m_data != NULL;
+#endif
+    }
+
+    void Close()
+    {
+#ifdef WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data)
+            munmap((void*)m_data, m_size);
+#endif
+        m_data = NULL;
+        m_size = 0;
+    }
+
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    const char* m_data;
+    size_t m_size;
+#ifdef WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#endif
+};
+
+/******************************************* filter *************************************************/
+
+struct CFilter
+{
+    std::string from;                 // timestamp prefixes, compared as text
+    std::string to;
+    int minLevel;
+    std::vector<unsigned int> threadIndexes;
+    std::vector<std::string> threadNames;
+    CKeywordMatcher keywords;
+    bool invert;                      // records without any of the keywords
+
+    CFilter() : minLevel(0), invert(false) {}
+};
+
+struct CRecordHeader
+{
+    const char* timestamp;            // timestampLength characters
+    unsigned int threadIndex;
+    const char* threadName;
+    size_t threadNameLength;
+    int level;
+    const char* text;                 // after "<level>: "
+};
+
+static inline bool IsContinuation(const char* line, const char* end)
+{
+    return (size_t)(end - line) >= continuationLength && memcmp(line, continuation, continuationLength) == 0;
+}
+
+// the level field at p: right aligned in 7 characters, then ": "
+static int ParseLevel(const char* p, const char* end)
+{
+    if (end - p < 9 || p[7] != ':' || p[8] != ' ')
+        return -1;
+    const char* name = p;
+    while (name < p + 7 && *name == ' ')
+        name++;
+    const size_t length = p + 7 - name;
+    for (int level = 0; level < levelCount; level++)
+    {
+        if (strlen(levelNames[level]) == length && memcmp(levelNames[level], name, length) == 0)
+            return level;
+    }
+    return -1;
+}
+
+// parse a header line [line, end), false if it isn't one
+static bool ParseHeader(const char* line, const char* end, CRecordHeader& header)
+{
+    int year, month, day, hours, minutes, seconds;
+    StringUtils::ParseResult result = StringUtils::ParseDate(line, end, year, month, day);
+    if (result.ec != StringUtils::PARSE_OK || result.ptr == end || *result.ptr != ' ')
+        return false;
+    result = StringUtils::ParseTime(result.ptr + 1, end, hours, minutes, seconds);
+    if (result.ec != StringUtils::PARSE_OK || end - result.ptr < 3 || memcmp(result.ptr, " T:", 3) != 0)
+        return false;
+    uint64_t index;
+    result = StringUtils::ParseUnsigned(result.ptr + 3, end, index);
+    if (result.ec != StringUtils::PARSE_OK || result.ptr == end || *result.ptr != ' ')
+        return false;
+
+    header.timestamp = line;
+    header.threadIndex = (unsigned int)index;
+    const char* p = result.ptr + 1;
+    header.level = ParseLevel(p, end);
+    if (header.level >= 0)
+    {
+        header.threadName = NULL;
+        header.threadNameLength = 0;
+        header.text = p + 9;
+        return true;
+    }
+    // "<name> <level>: ", the name is at most 15 characters and may contain spaces
+    for (const char* q = p + 2; q <= p + 16 && q < end; q++)
+    {
+        if (q[-1] == ' ' && (header.level = ParseLevel(q, end)) >= 0)
+        {
+            header.threadName = p;
+            header.threadNameLength = q - 1 - p;
+            header.text = q + 9;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool Matches(const CFilter& filter, const CRecordHeader& header, const char* recordEnd)
+{
+    if (header.level < filter.minLevel)
+        return false;
+    if (!filter.from.empty() && memcmp(header.timestamp, filter.from.data(), filter.from.size()) < 0)
+        return false;
+    if (!filter.to.empty() && memcmp(header.timestamp, filter.to.data(), filter.to.size()) > 0)
+        return false;
+
+    if (!filter.threadIndexes.empty() || !filter.threadNames.empty())
+    {
+        bool found = false;
+        for (size_t i = 0; i < filter.threadIndexes.size() && !found; i++)
+            found = filter.threadIndexes[i] == header.threadIndex;
+        for (size_t i = 0; i < filter.threadNames.size() && !found; i++)
+            found = filter.threadNames[i].size() == header.threadNameLength &&
+                    memcmp(filter.threadNames[i].data(), header.threadName, header.threadNameLength) == 0;
+        if (!found)
+            return false;
+    }
+
+    if (!filter.keywords.IsEmpty())
+        return filter.keywords.Contains(header.text, recordEnd - header.text) != filter.invert;
+    return true;
+}
+
+/******************************************* chunks *************************************************/
+
+struct CChunk
+{
+    const char* first;
+    const char* last;
+    std::string output;
+    unsigned long long matches;
+    bool done;
+};
+
+// the first record that starts at or after p
+static const char* NextRecordStart(const char* p, const char* begin, const char* end)
+{
+    if (p > begin && p[-1] != '\n')
+    {
+        p = (const char*)memchr(p, '\n', end - p);
+        if (!p)
+            return end;
+        p++;
+    }
+    while (p < end && IsContinuation(p, end))
+    {
+        p = (const char*)memchr(p, '\n', end - p);
+        if (!p)
+            return end;
+        p++;
+    }
+    return p;
+}
+
+static void SearchChunk(const CFilter& filter, bool countOnly, CChunk& chunk)
+{
+    const char* p = chunk.first;
+    const char* const end = chunk.last;
+    while (p < end)
+    {
+        // the header line, then its continuation lines
+        const char* recordEnd = (const char*)memchr(p, '\n', end - p);
+        recordEnd = recordEnd ? recordEnd + 1 : end;
+        CRecordHeader header = CRecordHeader();
+        const bool isRecord = ParseHeader(p, recordEnd, header);
+        while (recordEnd < end && IsContinuation(recordEnd, end))
+        {
+            const char* nl = (const char*)memchr(recordEnd, '\n', end - recordEnd);
+            recordEnd = nl ? nl + 1 : end;
+        }
+
+        // lines that are no record (damaged, or not a log at all) are skipped
+        if (isRecord && Matches(filter, header, recordEnd))
+        {
+            chunk.matches++;
+            if (!countOnly)
+            {
+                chunk.output.append(p, recordEnd - p);
+                if (recordEnd[-1] != '\n')
+                    chunk.output.push_back('\n');
+            }
+        }
+        p = recordEnd;
+    }
+}
+
+/* searchedSize: if not NULL, stop after the last complete line and return where that is */
+static unsigned long long GrepFile(const CFilter& filter, const char* path, const char* prefix, bool countOnly, unsigned int threads,
+                                   uint64_t* searchedSize = NULL)
+{
+    CMappedFile file;
+    if (!file.Open(path))
+    {
+        fprintf(stderr, "clog-grep: can't read %s\n", path);
+        return 0;
+    }
+    const char* begin = file.Data();
+    const char* end = begin + file.Size();
+    if (file.Size() >= 3 && memcmp(begin, "\xEF\xBB\xBF", 3) == 0)
+        begin += 3;
+    if (searchedSize)
+    {
+        while (end > begin && end[-1] != '\n')
+            end--;
+        *searchedSize = end - file.Data();
+    }
+    const char* start = begin;
+
+    // start near --from with the index clog-seek uses, if it fits this log
+    if (!filter.from.empty())
+    {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        CLogIndex index;
+        if (sscanf(filter.from.c_str(), "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) >= 3 &&
+            index.Load(std::string(path) + ".idx", file.Size()))
+        {
+            tm.tm_year -= 1900;
+            tm.tm_mon -= 1;
+            tm.tm_isdst = -1;
+            const time_t fromTime = mktime(&tm);
+            const uint64_t offset = fromTime == (time_t)-1 ? 0 : index.FindOffset((int64_t)fromTime);
+            if (file.Data() + offset > start)
+                start = file.Data() + offset;
+        }
+    }
+
+    std::vector<CChunk> chunks;
+    for (const char* p = start; p < end; )
+    {
+        CChunk chunk;
+        chunk.first = p;
+        chunk.last = (size_t)(end - p) > chunkSize ? NextRecordStart(p + chunkSize, begin, end) : end;
+        chunk.matches = 0;
+        chunk.done = false;
+        chunks.push_back(chunk);
+        p = chunk.last;
+    }
+
+    // the workers take the chunks in order, but stay at most a few chunks ahead of the output
+    const size_t window = threads * 4;
+    std::atomic<size_t> nextChunk(0);
+    size_t written = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads && t < chunks.size(); t++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            for (;;)
+            {
+                const size_t i = nextChunk++;
+                if (i >= chunks.size())
+                    return;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    changed.wait(lock, [&]() { return i < written + window; });
+                }
+                SearchChunk(filter, countOnly, chunks[i]);
+                std::lock_guard<std::mutex> lock(mutex);
+                chunks[i].done = true;
+                changed.notify_all();
+            }
+        }));
+    }
+
+    unsigned long long matches = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return chunks[i].done; });
+        }
+        matches += chunks[i].matches;
+        if (!countOnly && !chunks[i].output.empty())
+        {
+            if (prefix)
+            {
+                // "file:" before every line
+                const std::string& out = chunks[i].output;
+                for (size_t line = 0; line < out.size(); )
+                {
+                    const size_t nl = out.find('\n', line);
+                    fputs(prefix, stdout);
+                    fputc(':', stdout);
+                    fwrite(out.data() + line, nl + 1 - line, 1, stdout);
+                    line = nl + 1;
+                }
+            }
+            else
+                fwrite(chunks[i].output.data(), chunks[i].output.size(), 1, stdout);
+        }
+        std::string().swap(chunks[i].output);
+        std::lock_guard<std::mutex> lock(mutex);
+        written = i + 1;
+        changed.notify_all();
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    return matches;
+}
+
+/******************************************* follow *************************************************/
+
+#ifdef HAS_FOLLOW
+static const int followHoldMilliseconds = 200; // a held record is complete when nothing is appended for that long
+
+/*
+ * Parses what is appended to the log as it arrives. A record is shown as soon as
+ * its header line is complete; continuation lines that arrive later are shown
+ * with it, or the record is checked again with them if it didn't match yet (a
+ * keyword may be in a later line). With --invert and keywords a record is held
+ * instead until it is complete (the next header line, the end of the file or
+ * Flush()), as any later line may still contain a keyword.
+ */
+class CFollowParser
+{
+public:
+    CFollowParser(const CFilter& filter) :
+        m_filter(filter), m_hold(filter.invert && !filter.keywords.IsEmpty()), m_shown(false), m_held(false), m_atFileStart(true) {}
+
+    /* atFileStart: reading from the start of the file, where the BOM is; a held record is complete now */
+    void NewFile(bool atFileStart, std::string& out)
+    {
+        Flush(out);
+        m_line.clear();
+        m_record.clear();
+        m_shown = false;
+        m_atFileStart = atFileStart;
+    }
+
+    /* whether a record is held, Flush() it when nothing more was appended for a while */
+    bool IsHolding() const { return m_held; }
+
+    /* shows the held record if it matches; continuation lines that arrive after that are shown with it */
+    void Flush(std::string& out)
+    {
+        if (!m_held)
+            return;
+        m_held = false;
+        CRecordHeader header;
+        if (ParseHeader(m_record.data(), m_record.data() + m_record.size(), header) &&
+            Matches(m_filter, header, m_record.data() + m_record.size()))
+        {
+            out.append(m_record);
+            m_shown = true;
+        }
+    }
+
+    void Feed(const char* data, size_t length, std::string& out)
+    {
+        m_line.append(data, length);
+        if (m_atFileStart && m_line.size() >= 3)
+        {
+            if (m_line.compare(0, 3, "\xEF\xBB\xBF") == 0)
+                m_line.erase(0, 3);
+            m_atFileStart = false;
+        }
+
+        size_t start = 0;
+        for (size_t nl; (nl = m_line.find('\n', start)) != std::string::npos; start = nl + 1)
+            AddLine(m_line.data() + start, nl + 1 - start, out);
+        m_line.erase(0, start);
+    }
+
+private:
+    void AddLine(const char* line, size_t length, std::string& out)
+    {
+        CRecordHeader header;
+        if (IsContinuation(line, line + length))
+        {
+            if (m_record.empty())
+                return; // of a record before we started, or after a damaged line
+            m_record.append(line, length);
+            if (m_shown)
+                out.append(line, length);
+            else if (!m_held && !m_filter.keywords.IsEmpty() && ParseHeader(m_record.data(), m_record.data() + m_record.size(), header) &&
+                     Matches(m_filter, header, m_record.data() + m_record.size()))
+            {
+                out.append(m_record);
+                m_shown = true;
+            }
+            return;
+        }
+
+        Flush(out);
+        m_record.assign(line, length);
+        m_shown = false;
+        if (!ParseHeader(line, line + length, header))
+            m_record.clear();
+        else if (Matches(m_filter, header, line + length))
+        {
+            if (m_hold)
+                m_held = true; // a keyword in a later line still hides it
+            else
+            {
+                out.append(line, length);
+                m_shown = true;
+            }
+        }
+    }
+
+    const CFilter& m_filter;
+    const bool m_hold;    // records are shown only when complete
+    std::string m_line;   // incomplete line at the end of what was read
+    std::string m_record; // the last record, with the continuation lines so far
+    bool m_shown;
+    bool m_held;          // m_record matched so far and waits for the rest of it
+    bool m_atFileStart;
+};
+
+static std::string DirectoryOf(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    if (slash == std::string::npos)
+        return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+static std::string FileNameOf(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static void WriteOut(std::string& out)
+{
+    if (out.empty())
+        return;
+    fwrite(out.data(), out.size(), 1, stdout);
+    fflush(stdout);
+    out.clear();
+}
+
+/*
+ * Follow path from offset on: inotify reports appends to the open file, and when
+ * CLog::Init() moves it to name.old.log, the rest of the old file is read and the
+ * new name.log picked up as soon as it is created. Blocks in read() between events.
+ */
+static int Follow(const CFilter& filter, const char* path, uint64_t offset)
+{
+    const std::string fileName(FileNameOf(path));
+    const int notify = inotify_init1(IN_CLOEXEC);
+    if (notify < 0 || inotify_add_watch(notify, DirectoryOf(path).c_str(), IN_CREATE | IN_MOVED_TO) < 0)
+    {
+        fprintf(stderr, "clog-grep: can't watch the directory of %s: %s\n", path, strerror(errno));
+        return 2;
+    }
+
+    CFollowParser parser(filter);
+    int fd = -1;
+    int fileWatch = -1;
+    bool rotated = false;
+    std::string out;
+    std::vector<char> buffer(65536);
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;)
+    {
+        if (fd < 0)
+        {
+            // watch before opening, so no append is missed in between
+            fileWatch = inotify_add_watch(notify, path, IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+            fd = fileWatch >= 0 ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+            if (fd >= 0)
+            {
+                parser.NewFile(offset == 0, out);
+                rotated = false;
+            }
+        }
+
+        if (fd >= 0)
+        {
+            // read what was appended, a file that shrank was truncated and is read from the start
+            struct stat st;
+            if (fstat(fd, &st) == 0 && (uint64_t)st.st_size < offset)
+            {
+                offset = 0;
+                parser.NewFile(true, out);
+            }
+            ssize_t count;
+            while ((count = pread(fd, buffer.data(), buffer.size(), (off_t)offset)) > 0)
+            {
+                offset += count;
+                parser.Feed(buffer.data(), (size_t)count, out);
+            }
+            WriteOut(out);
+            if (rotated)
+            {
+                // the old file is read to its end, go on with the new one
+                parser.Flush(out);
+                WriteOut(out);
+                close(fd);
+                inotify_rm_watch(notify, fileWatch);
+                fd = -1;
+                offset = 0;
+                continue;
+            }
+        }
+
+        if (parser.IsHolding())
+        {
+            // the rest of a record is written right after its header line, if at all
+            struct pollfd pfd = { notify, POLLIN, 0 };
+            const int ready = poll(&pfd, 1, followHoldMilliseconds);
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready == 0)
+            {
+                parser.Flush(out);
+                WriteOut(out);
+                continue;
+            }
+        }
+
+        const ssize_t length = read(notify, events, sizeof(events));
+        if (length <= 0)
+        {
+            if (length < 0 && errno == EINTR)
+                continue;
+            fprintf(stderr, "clog-grep: inotify: %s\n", strerror(errno));
+            return 2;
+        }
+        for (const char* p = events; p < events + length; )
+        {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            if (event->wd == fileWatch && fd >= 0 && (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF)))
+                rotated = true;
+            else if (event->wd != fileWatch && fd >= 0 && event->len && fileName == event->name)
+                rotated = true; // a new file under our name, the old one is gone
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+#endif
+
+/******************************************* main *************************************************/
+
+static void Usage()
+{
+    printf("usage: clog-grep [options] <file.log>...\n");
+    printf("  -f, --from <time>      records at or after <time>\n");
+    printf("  -t, --to <time>        records up to <time>; times are local like in the log,\n");
+    printf("                         \"YYYY-MM-DD HH:MM:SS\" or a prefix (\"2024-05-01 13\" is that hour)\n");
+    printf("  -l, --level <level>    records of <level> and more severe (DEBUG ... FATAL)\n");
+    printf("  -T, --thread <t>       records of thread index or name <t>, can be repeated\n");
+    printf("  -k, --keyword <word>   records containing <word>, can be repeated (any of them)\n");
+    printf("  -i, --ignore-case      keywords match regardless of case\n");
+    printf("  -v, --invert           records containing none of the keywords\n");
+    printf("  -c, --count            only print the number of matching records\n");
+    printf("  -j, --jobs <n>         search with <n> threads (default: all cores)\n");
+#ifdef HAS_FOLLOW
+    printf("  -F, --follow           keep showing records as they are written, across log rotation;\n");
+    printf("                         starts at the end of the log, or at --from if given\n");
+#endif
+}
+
+static bool IsOption(const char* arg, const char* shortName, const char* longName)
+{
+    return strcmp(arg, shortName) == 0 || strcmp(arg, longName) == 0;
+}
+
+int main(int argc, char* argv[])
+{
+    CFilter filter;
+    std::vector<std::string> keywords;
+    std::vector<const char*> files;
+    bool ignoreCase = false;
+    bool countOnly = false;
+    bool follow = false;
+    unsigned int threads = std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (IsOption(arg, "-i", "--ignore-case"))
+            ignoreCase = true;
+        else if (IsOption(arg, "-v", "--invert"))
+            filter.invert = true;
+        else if (IsOption(arg, "-c", "--count"))
+            countOnly = true;
+#ifdef HAS_FOLLOW
+        else if (IsOption(arg, "-F", "--follow"))
+            follow = true;
+#endif
+        else if (hasValue && IsOption(arg, "-f", "--from"))
+            filter.from = std::string(argv[++i]).substr(0, timestampLength);
+        else if (hasValue && IsOption(arg, "-t", "--to"))
+            filter.to = std::string(argv[++i]).substr(0, timestampLength);
+        else if (hasValue && IsOption(arg, "-k", "--keyword"))
+            keywords.push_back(argv[++i]);
+        else if (hasValue && IsOption(arg, "-j", "--jobs"))
+            threads = (unsigned int)atoi(argv[++i]);
+        else if (hasValue && IsOption(arg, "-l", "--level"))
+        {
+            const std::string level(argv[++i]);
+            filter.minLevel = -1;
+            for (int l = 0; l < levelCount; l++)
+            {
+                if (StringUtils::EqualsNoCase(level, levelNames[l]))
+                    filter.minLevel = l;
+            }
+            if (filter.minLevel < 0)
+            {
+                fprintf(stderr, "clog-grep: unknown level %s\n", level.c_str());
+                return 2;
+            }
+        }
+        else if (hasValue && IsOption(arg, "-T", "--thread"))
+        {
+            const std::string thread(argv[++i]);
+            if (StringUtils::IsNaturalNumber(thread))
+                filter.threadIndexes.push_back((unsigned int)atoi(thread.c_str()));
+            else
+                filter.threadNames.push_back(thread);
+        }
+        else if (arg[0] == '-' && arg[1] != 0)
+        {
+            Usage();
+            return 2;
+        }
+        else
+            files.push_back(arg);
+    }
+    if (files.empty())
+    {
+        Usage();
+        return 2;
+    }
+    if (threads < 1)
+        threads = 1;
+    if (!keywords.empty())
+        filter.keywords.Build(keywords, ignoreCase);
+
+#ifdef HAS_FOLLOW
+    if (follow)
+    {
+        if (files.size() != 1 || countOnly)
+        {
+            fprintf(stderr, "clog-grep: --follow takes one file and no --count\n");
+            return 2;
+        }
+        uint64_t offset = 0;
+        if (!filter.from.empty())
+            GrepFile(filter, files[0], NULL, false, threads, &offset);
+        else
+        {
+            struct stat st;
+            if (stat(files[0], &st) == 0)
+                offset = (uint64_t)st.st_size;
+        }
+        fflush(stdout);
+        return Follow(filter, files[0], offset);
+    }
+#endif
+
+    unsigned long long matches = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const unsigned long long fileMatches = GrepFile(filter, files[i], files.size() > 1 ? files[i] : NULL, countOnly, threads);
+        if (countOnly)
+        {
+            if (files.size() > 1)
+                printf("%s:%llu\n", files[i], fileMatches);
+            else
+                printf("%llu\n", fileMatches);
+        }
+        matches += fileMatches;
+    }
+    return matches ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "utils/LogIndex.h"
+
+/*
+ * clog-seek: print the records of a text log between two local times, jumping
+ * close to the start with the name.log.idx index instead of reading the whole log.
+ */
+
+#ifdef WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+// "YYYY-MM-DD HH:MM:SS T:" at the start of a record line
+static const size_t timestampLength = 19;
+
+static bool IsRecordStart(const std::string& line)
+{
+    return line.size() > timestampLength + 2 && line[4] == '-' && line[7] == '-' && line[10] == ' ' &&
+           line[13] == ':' && line[16] == ':' && line.compare(timestampLength, 3, " T:") == 0;
+}
+
+// "YYYY-MM-DD[ HH[:MM[:SS]]]", missing fields are 0
+static bool ParseLocalTime(const char* text, time_t& result)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const int fields = sscanf(text, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (fields < 3)
+        return false;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    result = mktime(&tm);
+    return result != (time_t)-1;
+}
+
+static bool ReadLine(FILE* file, std::string& line)
+{
+    line.clear();
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        line.append(buffer);
+        if (!line.empty() && line[line.size() - 1] == '\n')
+            return true;
+    }
+    return !line.empty();
+}
+
+static void Usage()
+{
+    printf("usage: clog-seek <name.log> <from> [to]\n");
+    printf("  prints the records from the first one at or after <from> up to the last one\n");
+    printf("  in <to> (or to the end of the log), times are local like in the log:\n");
+    printf("  \"YYYY-MM-DD HH:MM:SS\", shorter prefixes (\"2024-05-01 13:05\") cover the whole\n");
+    printf("  minute, hour or day. Uses <name.log>.idx when there is one.\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3 || argc > 4)
+    {
+        Usage();
+        return 1;
+    }
+
+    const std::string logPath(argv[1]);
+    const std::string from(argv[2]);
+    const std::string to(argc > 3 ? argv[3] : "");
+    time_t fromTime;
+    if (!ParseLocalTime(from.c_str(), fromTime) || (!to.empty() && to.size() < 10))
+    {
+        fprintf(stderr, "clog-seek: times are \"YYYY-MM-DD[ HH[:MM[:SS]]]\"\n");
+        return 1;
+    }
+
+    FILE* file = fopen(logPath.c_str(), "rb");
+    if (!file)
+    {
+        fprintf(stderr, "clog-seek: can't open %s\n", logPath.c_str());
+        return 1;
+    }
+    fseek64(file, 0, SEEK_END);
+    const uint64_t logSize = (uint64_t)ftell64(file);
+
+    uint64_t offset = 0;
+    CLogIndex index;
+    if (index.Load(logPath + ".idx", logSize))
+        offset = index.FindOffset((int64_t)fromTime);
+    else
+        fprintf(stderr, "clog-seek: no index for %s, reading it all\n", logPath.c_str());
+    fseek64(file, (long long)offset, SEEK_SET);
+    char bom[3];
+    if (offset == 0 && (fread(bom, 1, sizeof(bom), file) != sizeof(bom) || memcmp(bom, "\xEF\xBB\xBF", sizeof(bom)) != 0))
+        fseek64(file, 0, SEEK_SET);
+
+    // compare the timestamps as text, as long as the arguments are given
+    std::string line;
+    bool inRange = false;
+    while (ReadLine(file, line))
+    {
+        if (IsRecordStart(line))
+        {
+            if (!to.empty() && line.compare(0, to.size(), to) > 0)
+                break;
+            inRange = line.compare(0, from.size(), from) >= 0;
+        }
+        // continuation lines go with their record
+        if (inRange)
+            fwrite(line.data(), line.size(), 1, stdout);
+    }
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,779 @@
+#include "BinaryLog.h"
+#include "log.h"
+#include "utils/StringBuilder.h"
+#include "utils/StringUtils.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+enum RecordType
+{
+  RECORD_FORMAT = 1,
+  RECORD_TIME,
+  RECORD_THREAD,
+  RECORD_MESSAGE,
+  RECORD_STRING,
+  RECORD_CONTEXT,
+  RECORD_THREAD_CONTEXT
+};
+
+static const char fileMagic[8] = { 'C', 'L', 'O', 'G', 'B', 'I', 'N', 1 };
+// formats built at run time could fill the format dictionary, it starts over when it has this many
+static const size_t maxFormats = 16384;
+// contexts are often per request, the dictionary starts over when it has this many
+static const size_t maxContexts = 1024;
+
+static inline void PutVarint(std::string &out, uint64_t value)
+{
+  char bytes[10];
+  size_t count = 0;
+  while (value >= 0x80)
+  {
+    bytes[count++] = (char)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[count++] = (char)value;
+  out.append(bytes, count);
+}
+
+static inline void PutSigned(std::string &out, int64_t value)
+{
+  PutVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static inline void PutDouble(std::string &out, double value)
+{
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  char bytes[8];
+  for (int i = 0; i < 8; i++, bits >>= 8)
+    bytes[i] = (char)(bits & 0xFF);
+  out.append(bytes, sizeof(bytes));
+}
+
+/******************************************* CBinaryLogSpec *************************************************/
+
+int CBinaryLogSpec::Next(const char *format, CBinaryLogSpec &spec)
+{
+  const char *p = strchr(format, '%');
+  if (!p)
+    return 0;
+
+  spec.start = p++;
+  spec.stars = 0;
+  spec.precision = -1;
+  if (*p == '%')
+  {
+    spec.kind = LITERAL_PERCENT;
+    spec.end = p + 1;
+    return 1;
+  }
+
+  // positional arguments ("%1$s") would need all of them read out of order
+  const char *digits = p;
+  while (*digits >= '0' && *digits <= '9')
+    digits++;
+  if (*digits == '$')
+    return -1;
+
+  while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'')
+    p++;
+  if (*p == '*')
+  {
+    spec.stars++;
+    p++;
+  }
+  else
+  {
+    while (*p >= '0' && *p <= '9')
+      p++;
+  }
+  if (*p == '.')
+  {
+    p++;
+    if (*p == '*')
+    {
+      spec.stars++;
+      spec.precision = -2;
+      p++;
+    }
+    else
+    {
+      spec.precision = 0;
+      while (*p >= '0' && *p <= '9')
+      {
+        if (spec.precision < 100000000)
+          spec.precision = spec.precision * 10 + (*p - '0');
+        p++;
+      }
+    }
+  }
+
+  enum { LEN_NONE, LEN_LONG, LEN_LONGLONG, LEN_INTMAX, LEN_SIZE, LEN_PTRDIFF, LEN_OTHER } length = LEN_NONE;
+  switch (*p)
+  {
+  case 'h': // char and short are promoted to int
+    p += p[1] == 'h' ? 2 : 1;
+    break;
+  case 'l':
+    if (p[1] == 'l')
+    {
+      length = LEN_LONGLONG;
+      p += 2;
+    }
+    else
+    {
+      length = LEN_LONG;
+      p++;
+    }
+    break;
+  case 'q': length = LEN_LONGLONG; p++; break;
+  case 'j': length = LEN_INTMAX; p++; break;
+  case 'z': length = LEN_SIZE; p++; break;
+  case 't': length = LEN_PTRDIFF; p++; break;
+  case 'L': length = LEN_OTHER; p++; break;
+  case 'I': // MSVC: I64, I32, I
+    if (p[1] == '6' && p[2] == '4')
+    {
+      length = LEN_LONGLONG;
+      p += 3;
+    }
+    else if (p[1] == '3' && p[2] == '2')
+      p += 3;
+    else
+    {
+      length = LEN_SIZE;
+      p++;
+    }
+    break;
+  }
+
+  switch (*p)
+  {
+  case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+    switch (length)
+    {
+    case LEN_NONE:     spec.kind = INT; break;
+    case LEN_LONG:     spec.kind = LONG; break;
+    case LEN_LONGLONG: spec.kind = LONGLONG; break;
+    case LEN_INTMAX:   spec.kind = INTMAX; break;
+    case LEN_SIZE:     spec.kind = SIZE; break;
+    case LEN_PTRDIFF:  spec.kind = PTRDIFF; break;
+    default:           return -1;
+    }
+    break;
+  case 'c':
+    if (length != LEN_NONE)
+      return -1; // wint_t
+    spec.kind = INT;
+    break;
+  case 's':
+    if (length != LEN_NONE)
+      return -1; // wide string
+    spec.kind = STRING;
+    break;
+  case 'p':
+    if (length != LEN_NONE)
+      return -1;
+    spec.kind = POINTER;
+    break;
+  case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+    if (length != LEN_NONE && length != LEN_LONG)
+      return -1; // long double
+    spec.kind = DOUBLE;
+    break;
+  default: // %n, %m, %S, %C, unknown or end of the format
+    return -1;
+  }
+  spec.end = p + 1;
+  return 1;
+}
+
+/******************************************* CBinaryLogWriter *************************************************/
+
+CBinaryLogWriter::CBinaryLogWriter() :
+  m_lastTime(0), m_lastSecond(INT64_MIN), m_nextFormatId(0)
+{
+}
+
+static int64_t MicrosecondsNow()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void CBinaryLogWriter::Begin(std::string &out)
+{
+  m_formats.clear();
+  m_formatTexts.clear();
+  m_threads.clear();
+  m_threadContexts.clear();
+  m_contexts.clear();
+  m_nextFormatId = 0;
+  m_lastSecond = INT64_MIN;
+  m_lastTime = MicrosecondsNow();
+  out.append(fileMagic, sizeof(fileMagic));
+  PutSigned(out, m_lastTime);
+}
+
+const CBinaryLogWriter::CFormat& CBinaryLogWriter::GetFormat(std::string &out, const char *format)
+{
+  bool added;
+  const CFormat &entry = FindFormat(format, added);
+  if (added && entry.capturable)
+  {
+    out.push_back((char)RECORD_FORMAT);
+    const size_t length = strlen(format);
+    PutVarint(out, entry.id);
+    PutVarint(out, length);
+    out.append(format, length);
+  }
+  return entry;
+}
+
+CBinaryLogWriter::CFormat& CBinaryLogWriter::FindFormat(const char *format, bool &added)
+{
+  std::unordered_map<const char*, CFormatTexts::value_type*>::iterator it = m_formats.find(format);
+  added = false;
+  if (it != m_formats.end() && strcmp(it->second->first.c_str(), format) == 0)
+    return it->second->second;
+
+  // a format at a new (or reused) address, the same text may be known already
+  const std::string text(format);
+  CFormatTexts::iterator known = m_formatTexts.find(text);
+  if (m_formats.size() >= maxFormats)
+    m_formats.clear();
+  if (known != m_formatTexts.end())
+  {
+    m_formats[format] = &*known;
+    return known->second;
+  }
+  if (m_formatTexts.size() >= maxFormats)
+  {
+    // ids are reused, each format is written again before its next record
+    m_formatTexts.clear();
+    m_formats.clear();
+    m_nextFormatId = 0;
+  }
+
+  // new format: work out what to read from the va_list
+  CFormatTexts::value_type &inserted = *m_formatTexts.insert(CFormatTexts::value_type(text, CFormat())).first;
+  m_formats[format] = &inserted;
+  added = true;
+  CFormat &entry = inserted.second;
+  entry.id = m_nextFormatId++;
+  entry.capturable = true;
+  entry.kinds.clear();
+  entry.precisions.clear();
+
+  CBinaryLogSpec spec;
+  int result;
+  for (const char *p = format; (result = CBinaryLogSpec::Next(p, spec)) != 0; p = spec.end)
+  {
+    if (result < 0)
+    {
+      entry.capturable = false;
+      break;
+    }
+    if (spec.kind == CBinaryLogSpec::LITERAL_PERCENT)
+      continue;
+    for (unsigned int i = 0; i < spec.stars; i++)
+    {
+      entry.kinds.push_back(CBinaryLogSpec::INT);
+      entry.precisions.push_back(-1);
+    }
+    entry.kinds.push_back(spec.kind);
+    entry.precisions.push_back(spec.precision);
+  }
+  return entry;
+}
+
+void CBinaryLogWriter::AppendHeader(std::string &out, int type, int level, const CLogThreadInfo &thread, const CLogTime *time /* = NULL */)
+{
+  const int64_t now = MicrosecondsNow();
+  const int64_t second = now / 1000000;
+  CLogTime current;
+  if (time)
+    m_lastSecond = INT64_MIN; // the next record writes the current time again
+  else if (second != m_lastSecond)
+  {
+    m_lastSecond = second;
+    PlatformInterfaceForCLog::GetCurrentLocalTime(current.year, current.month, current.day, current.hour, current.minute, current.second);
+    time = &current;
+  }
+  if (time)
+  {
+    out.push_back((char)RECORD_TIME);
+    PutSigned(out, time->year);
+    PutSigned(out, time->month);
+    PutSigned(out, time->day);
+    PutSigned(out, time->hour);
+    PutSigned(out, time->minute);
+    PutSigned(out, time->second);
+  }
+
+  if (thread.index >= m_threads.size())
+    m_threads.resize(thread.index + 1, 0);
+  if (m_threads[thread.index] != thread.nameVersion + 1)
+  {
+    m_threads[thread.index] = thread.nameVersion + 1;
+    out.push_back((char)RECORD_THREAD);
+    PutVarint(out, thread.index);
+    PutVarint(out, thread.tid);
+    PutVarint(out, thread.nameLength);
+    out.append(thread.name, thread.nameLength);
+  }
+
+  // threads start without a context, as if version 0 was written
+  if (thread.index >= m_threadContexts.size())
+    m_threadContexts.resize(thread.index + 1, 1);
+  if (m_threadContexts[thread.index] != thread.contextVersion + 1)
+  {
+    m_threadContexts[thread.index] = thread.contextVersion + 1;
+    uint32_t id = 0;
+    if (thread.contextLength)
+    {
+      const std::string context(thread.context, thread.contextLength);
+      std::unordered_map<std::string, uint32_t>::iterator it = m_contexts.find(context);
+      if (it != m_contexts.end())
+        id = it->second;
+      else
+      {
+        if (m_contexts.size() >= maxContexts)
+        {
+          // ids are reused: every other thread writes its context again with its next record
+          m_contexts.clear();
+          for (size_t i = 0; i < m_threadContexts.size(); i++)
+            m_threadContexts[i] = 0;
+          m_threadContexts[thread.index] = thread.contextVersion + 1;
+        }
+        id = (uint32_t)m_contexts.size() + 1;
+        m_contexts[context] = id;
+        out.push_back((char)RECORD_CONTEXT);
+        PutVarint(out, id);
+        PutVarint(out, context.size());
+        out.append(context);
+      }
+    }
+    out.push_back((char)RECORD_THREAD_CONTEXT);
+    PutVarint(out, thread.index);
+    PutVarint(out, id);
+  }
+
+  out.push_back((char)type);
+  PutSigned(out, level & LOGMASK); // without the extra log level bits, like the text log
+  PutSigned(out, now - m_lastTime);
+  m_lastTime = now;
+  PutVarint(out, thread.index);
+}
+
+bool CBinaryLogWriter::AppendMessage(std::string &out, int level, const CLogThreadInfo &thread, const char *format, va_list args)
+{
+  const CFormat &entry = GetFormat(out, format);
+  if (!entry.capturable)
+    return false;
+
+  AppendHeader(out, RECORD_MESSAGE, level, thread);
+  PutVarint(out, entry.id);
+  AppendValues(out, entry, args);
+  return true;
+}
+
+bool CBinaryLogWriter::AppendArguments(std::string &out, const char *format, va_list args)
+{
+  bool added;
+  const CFormat &entry = FindFormat(format, added);
+  if (!entry.capturable)
+    return false;
+  AppendValues(out, entry, args);
+  return true;
+}
+
+void CBinaryLogWriter::AppendValues(std::string &out, const CFormat &entry, va_list args)
+{
+  va_list argCopy;
+  va_copy(argCopy, args);
+  int lastInt = 0; // the '*' precision of a string is the int right before it
+  for (size_t i = 0; i < entry.kinds.size(); i++)
+  {
+    switch (entry.kinds[i])
+    {
+    case CBinaryLogSpec::INT:
+      lastInt = va_arg(argCopy, int);
+      PutSigned(out, lastInt);
+      break;
+    case CBinaryLogSpec::LONG:     PutSigned(out, va_arg(argCopy, long)); break;
+    case CBinaryLogSpec::LONGLONG: PutSigned(out, va_arg(argCopy, long long)); break;
+    case CBinaryLogSpec::INTMAX:   PutSigned(out, (int64_t)va_arg(argCopy, intmax_t)); break;
+    case CBinaryLogSpec::SIZE:     PutSigned(out, (int64_t)va_arg(argCopy, size_t)); break;
+    case CBinaryLogSpec::PTRDIFF:  PutSigned(out, (int64_t)va_arg(argCopy, ptrdiff_t)); break;
+    case CBinaryLogSpec::DOUBLE:   PutDouble(out, va_arg(argCopy, double)); break;
+    case CBinaryLogSpec::POINTER:  PutVarint(out, (uintptr_t)va_arg(argCopy, void*)); break;
+    case CBinaryLogSpec::STRING:
+    {
+      const char *str = va_arg(argCopy, const char*);
+      if (!str)
+      {
+        PutVarint(out, 0);
+        break;
+      }
+      // with a precision the string doesn't have to be terminated
+      int precision = entry.precisions[i];
+      if (precision == -2)
+        precision = lastInt >= 0 ? lastInt : -1;
+      size_t length;
+      if (precision >= 0)
+      {
+        const char *nul = (const char *)memchr(str, 0, precision);
+        length = nul ? nul - str : (size_t)precision;
+      }
+      else
+        length = strlen(str);
+      PutVarint(out, length + 1);
+      out.append(str, length);
+      break;
+    }
+    }
+  }
+  va_end(argCopy);
+}
+
+void CBinaryLogWriter::AppendString(std::string &out, int level, const CLogThreadInfo &thread, const char *str, size_t length,
+                                    const CLogTime *time /* = NULL */)
+{
+  AppendHeader(out, RECORD_STRING, level, thread, time);
+  PutVarint(out, length);
+  out.append(str, length);
+}
+
+/******************************************* CBinaryLogReader *************************************************/
+
+CBinaryLogReader::CBinaryLogReader() :
+  m_data(NULL), m_pos(NULL), m_end(NULL), m_time(0),
+  m_contexts(1), m_repeatLogLevel(-1), m_repeatCount(0), m_lastThread(0), m_repeatContext(0), m_pendingTime(0)
+{
+  memset(m_localTime, 0, sizeof(m_localTime));
+}
+
+bool CBinaryLogReader::Open(const char *data, size_t size)
+{
+  *this = CBinaryLogReader();
+  if (size < sizeof(fileMagic) || memcmp(data, fileMagic, sizeof(fileMagic)) != 0)
+    return false;
+  m_data = data;
+  m_pos = data + sizeof(fileMagic);
+  m_end = data + size;
+  return ReadSigned(m_time);
+}
+
+bool CBinaryLogReader::ReadVarint(uint64_t &value)
+{
+  value = 0;
+  for (unsigned int shift = 0; m_pos < m_end && shift < 64; shift += 7)
+  {
+    const unsigned char byte = *m_pos++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool CBinaryLogReader::ReadSigned(int64_t &value)
+{
+  uint64_t raw;
+  if (!ReadVarint(raw))
+    return false;
+  value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+  return true;
+}
+
+bool CBinaryLogReader::ReadBytes(const char *&bytes, size_t length)
+{
+  if ((size_t)(m_end - m_pos) < length)
+    return false;
+  bytes = m_pos;
+  m_pos += length;
+  return true;
+}
+
+template<typename T>
+static int FormatConversion(char *buffer, size_t size, const char *conversion, const int *stars, unsigned int starCount, T value)
+{
+  switch (starCount)
+  {
+  case 0:  return snprintf(buffer, size, conversion, value);
+  case 1:  return snprintf(buffer, size, conversion, stars[0], value);
+  default: return snprintf(buffer, size, conversion, stars[0], stars[1], value);
+  }
+}
+
+template<typename T>
+static bool AppendConversion(std::string &text, const std::string &conversion, const int *stars, unsigned int starCount, T value)
+{
+  char buffer[256];
+  const int length = FormatConversion(buffer, sizeof(buffer), conversion.c_str(), stars, starCount, value);
+  if (length < 0)
+    return false;
+  if ((size_t)length < sizeof(buffer))
+    text.append(buffer, length);
+  else
+  {
+    const size_t size = text.size();
+    text.resize(size + length + 1);
+    FormatConversion(&text[size], length + 1, conversion.c_str(), stars, starCount, value);
+    text.resize(size + length);
+  }
+  return true;
+}
+
+bool CBinaryLogReader::FormatArguments(const char *format, const std::string &arguments, std::string &text)
+{
+  CBinaryLogReader reader;
+  reader.m_data = reader.m_pos = arguments.data();
+  reader.m_end = reader.m_pos + arguments.size();
+  return reader.FormatMessage(format, text) && reader.IsAtEnd();
+}
+
+bool CBinaryLogReader::FormatMessage(const char *format, std::string &text)
+{
+  text.clear();
+  CBinaryLogSpec spec;
+  std::string conversion;
+  const char *p = format;
+  int result;
+  for (; (result = CBinaryLogSpec::Next(p, spec)) != 0; p = spec.end)
+  {
+    if (result < 0)
+      return false; // the writer doesn't store these
+    text.append(p, spec.start - p);
+    if (spec.kind == CBinaryLogSpec::LITERAL_PERCENT)
+    {
+      text.push_back('%');
+      continue;
+    }
+
+    int stars[2];
+    for (unsigned int i = 0; i < spec.stars; i++)
+    {
+      int64_t star;
+      if (!ReadSigned(star))
+        return false;
+      stars[i] = (int)star;
+    }
+    conversion.assign(spec.start, spec.end - spec.start);
+
+    int64_t integer;
+    uint64_t raw;
+    const char *bytes;
+    bool ok;
+    switch (spec.kind)
+    {
+    case CBinaryLogSpec::INT:      ok = ReadSigned(integer) && AppendConversion(text, conversion, stars, spec.stars, (int)integer); break;
+    case CBinaryLogSpec::LONG:     ok = ReadSigned(integer) && AppendConversion(text, conversion, stars, spec.stars, (long)integer); break;
+    case CBinaryLogSpec::LONGLONG: ok = ReadSigned(integer) && AppendConversion(text, conversion, stars, spec.stars, (long long)integer); break;
+    case CBinaryLogSpec::INTMAX:   ok = ReadSigned(integer) && AppendConversion(text, conversion, stars, spec.stars, (intmax_t)integer); break;
+    case CBinaryLogSpec::SIZE:     ok = ReadSigned(integer) && AppendConversion(text, conversion, stars, spec.stars, (size_t)integer); break;
+    case CBinaryLogSpec::PTRDIFF:  ok = ReadSigned(integer) && AppendConversion(text, conversion, stars, spec.stars, (ptrdiff_t)integer); break;
+    case CBinaryLogSpec::POINTER:  ok = ReadVarint(raw) && AppendConversion(text, conversion, stars, spec.stars, (void*)(uintptr_t)raw); break;
+    case CBinaryLogSpec::DOUBLE:
+    {
+      ok = ReadBytes(bytes, 8);
+      if (ok)
+      {
+        uint64_t bits = 0;
+        for (int i = 7; i >= 0; i--)
+          bits = (bits << 8) | (unsigned char)bytes[i];
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        ok = AppendConversion(text, conversion, stars, spec.stars, value);
+      }
+      break;
+    }
+    case CBinaryLogSpec::STRING:
+    {
+      ok = ReadVarint(raw) && (raw == 0 || ReadBytes(bytes, raw - 1));
+      if (ok)
+      {
+        if (raw == 0)
+          ok = AppendConversion(text, conversion, stars, spec.stars, (const char*)NULL);
+        else
+        {
+          const std::string str(bytes, raw - 1);
+          ok = AppendConversion(text, conversion, stars, spec.stars, str.c_str());
+        }
+      }
+      break;
+    }
+    default:
+      ok = false;
+    }
+    if (!ok)
+      return false;
+  }
+  text.append(p);
+  return true;
+}
+
+bool CBinaryLogReader::NextMessage(int &level, unsigned int &thread, std::string &text)
+{
+  while (m_pos < m_end)
+  {
+    const char *start = m_pos;
+    const int type = (unsigned char)*m_pos++;
+    uint64_t id, length, tid;
+    int64_t value, delta;
+    const char *bytes;
+    bool ok = false;
+    switch (type)
+    {
+    case RECORD_FORMAT:
+      ok = ReadVarint(id) && id < 0x10000000 && ReadVarint(length) && ReadBytes(bytes, length);
+      if (ok)
+      {
+        if (id >= m_formats.size())
+          m_formats.resize(id + 1);
+        m_formats[id].assign(bytes, length);
+      }
+      break;
+    case RECORD_TIME:
+      ok = true;
+      for (int i = 0; i < 6 && ok; i++)
+      {
+        ok = ReadSigned(value);
+        m_localTime[i] = (int)value;
+      }
+      break;
+    case RECORD_THREAD:
+      ok = ReadVarint(id) && id < 0x10000000 && ReadVarint(tid) && ReadVarint(length) && ReadBytes(bytes, length);
+      if (ok)
+      {
+        if (id >= m_threadNames.size())
+          m_threadNames.resize(id + 1);
+        m_threadNames[id].assign(bytes, length);
+      }
+      break;
+    case RECORD_CONTEXT:
+      ok = ReadVarint(id) && id != 0 && id < 0x10000000 && ReadVarint(length) && ReadBytes(bytes, length);
+      if (ok)
+      {
+        if (id >= m_contexts.size())
+          m_contexts.resize(id + 1);
+        m_contexts[id].assign(bytes, length);
+      }
+      break;
+    case RECORD_THREAD_CONTEXT:
+      ok = ReadVarint(tid) && tid < 0x10000000 && ReadVarint(id) && id < 0x10000000;
+      if (ok)
+      {
+        if (tid >= m_threadContexts.size())
+          m_threadContexts.resize(tid + 1, 0);
+        m_threadContexts[tid] = (uint32_t)id;
+      }
+      break;
+    case RECORD_MESSAGE:
+    case RECORD_STRING:
+      ok = ReadSigned(value) && value >= LOGDEBUG && value <= LOGNONE && ReadSigned(delta) && ReadVarint(id);
+      if (ok)
+      {
+        level = (int)value;
+        thread = (unsigned int)id;
+        if (type == RECORD_MESSAGE)
+          ok = ReadVarint(id) && id < m_formats.size() && FormatMessage(m_formats[id].c_str(), text);
+        else
+        {
+          ok = ReadVarint(length) && ReadBytes(bytes, length);
+          if (ok)
+            text.assign(bytes, length);
+        }
+      }
+      if (ok)
+      {
+        m_time += delta;
+        return true;
+      }
+      break;
+    }
+    if (!ok)
+    {
+      m_pos = start; // cut short or damaged, stop here
+      return false;
+    }
+  }
+  return false;
+}
+
+uint32_t CBinaryLogReader::GetThreadContext(unsigned int thread) const
+{
+  return thread < m_threadContexts.size() ? m_threadContexts[thread] : 0;
+}
+
+void CBinaryLogReader::AppendRecord(std::string &out, int level, unsigned int thread, bool withContext, const char *text, size_t length)
+{
+  CLogTime time;
+  time.year = m_localTime[0];
+  time.month = m_localTime[1];
+  time.day = m_localTime[2];
+  time.hour = m_localTime[3];
+  time.minute = m_localTime[4];
+  time.second = m_localTime[5];
+  const std::string *name = thread < m_threadNames.size() ? &m_threadNames[thread] : NULL;
+  const uint32_t contextId = withContext ? GetThreadContext(thread) : 0;
+  const std::string *context = contextId < m_contexts.size() ? &m_contexts[contextId] : NULL;
+
+  CStringBuilder record;
+  CLog::FormatRecord(record, time, thread, name ? name->data() : NULL, name ? name->size() : 0, level,
+                     context ? context->data() : NULL, context ? context->size() : 0, text, length);
+  out = record.Release();
+}
+
+bool CBinaryLogReader::NextRecord(std::string &text, int64_t *time /* = NULL */)
+{
+  if (!m_pending.empty())
+  {
+    text.swap(m_pending);
+    m_pending.clear();
+    if (time)
+      *time = m_pendingTime;
+    return true;
+  }
+
+  // same as CLog::LogString()
+  int level;
+  unsigned int thread;
+  std::string message;
+  while (NextMessage(level, thread, message))
+  {
+    const char *first = message.data();
+    const size_t length = StringUtils::TrimRightView(first, first + message.size()) - first;
+    if (length == 0)
+      continue;
+
+    const uint32_t context = GetThreadContext(thread);
+    if (m_repeatLogLevel == level && m_repeatLine.compare(0, std::string::npos, first, length) == 0 && m_lastThread == thread
+        && m_repeatContext == context)
+    {
+      m_repeatCount++;
+      continue;
+    }
+
+    if (time)
+      *time = m_time;
+    if (m_repeatCount)
+    {
+      const std::string repeats = StringUtils::Format("Previous line repeats %d times.", m_repeatCount);
+      AppendRecord(text, m_repeatLogLevel, thread, false, repeats.data(), repeats.size());
+      m_repeatCount = 0;
+      AppendRecord(m_pending, level, thread, true, first, length);
+      m_pendingTime = m_time;
+    }
+    else
+      AppendRecord(text, level, thread, true, first, length);
+
+    m_lastThread = thread;
+    m_repeatContext = context;
+    m_repeatLine.assign(first, length);
+    m_repeatLogLevel = level;
+    return true;
+  }
+  return false;
+}
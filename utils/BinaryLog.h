@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CLogThreadInfo;
+struct CLogTime;
+
+/*!
+ \brief Compact binary log file format (LOG_FORMAT_BINARY).
+
+ Instead of a line of text, a Log() call is stored as its format string id and
+ its raw arguments, the text is only produced when the file is decoded
+ (CBinaryLogReader, clog-decode). All integers are LEB128 varints, signed
+ ones zigzag encoded.
+
+ File: "CLOGBIN" 0x01 (magic and version), varint start time (microseconds since
+ the epoch), then records. Each record starts with a type byte:
+  - FORMAT:  varint id, varint length, format string. The format dictionary,
+             an entry is written just before the first record that uses it. The writer
+             starts the dictionary over after 16384 texts (formats built at run time),
+             an id can then be written again with another format.
+  - TIME:    6 zigzag varints, the local time (year, month, day, hour, minute, second)
+             the text log would print, written whenever the second changes.
+  - THREAD:  varint index, varint kernel tid, varint length, name. Written before
+             a thread's first record and again after it got a new name.
+  - MESSAGE: zigzag level, zigzag time delta to the previous record (microseconds),
+             varint thread index, varint format id, then the arguments in order:
+             integers as zigzag varints, doubles as 8 bytes little endian, pointers as
+             varints, strings as varint (length + 1, 0 for NULL) and the bytes.
+  - STRING:  zigzag level, time delta, thread index, varint length, the text.
+             For messages that are already text (LogString(), LogFunction()...) and
+             formats that can't be captured (%n, %ls, long double, positional args).
+  - CONTEXT: varint id (from 1), varint length, text. A CLogContext text, the context
+             dictionary, written just before the first THREAD_CONTEXT that uses it.
+             The writer starts the dictionary over after 1024 texts, an id can then be
+             written again with another text; every thread gets a new THREAD_CONTEXT first.
+  - THREAD_CONTEXT: varint thread index, varint context id (0 for none). The context of
+             the thread's records from here on, written when it changed since its last record.
+
+ Repeated lines are not collapsed when writing, the reader does that the same way
+ CLog::LogString() does, so the decoded text is identical to the text log.
+ */
+
+/*! \brief One printf conversion, as far as capturing its arguments is concerned. */
+struct CBinaryLogSpec
+{
+  enum Kind
+  {
+    LITERAL_PERCENT, // "%%", no argument
+    INT,
+    LONG,
+    LONGLONG,
+    INTMAX,
+    SIZE,
+    PTRDIFF,
+    DOUBLE,
+    STRING,
+    POINTER
+  };
+
+  const char *start;  // the conversion in the format string, from '%' ...
+  const char *end;    // ... to one past the conversion character
+  unsigned char kind;
+  unsigned char stars; // number of '*' width/precision int arguments before the value
+  int precision;       // for strings: -1 none, -2 from a '*' argument, else the precision
+
+  /*! \brief Find the next conversion in the format, starting at format.
+   \return 1 if one was found, 0 at the end of the format, -1 for a conversion
+           whose arguments can't be captured
+   */
+  static int Next(const char *format, CBinaryLogSpec &spec);
+};
+
+class CBinaryLogWriter
+{
+public:
+  CBinaryLogWriter();
+
+  /*! \brief Start a new file, appends the file header to out and forgets the dictionary. */
+  void Begin(std::string &out);
+
+  /*! \brief Append a Log() call to out.
+   \return false (and out untouched) if the format can't be captured, write it as text then
+   */
+  bool AppendMessage(std::string &out, int level, const CLogThreadInfo &thread, const char *format, va_list args);
+  /*! \brief Append an already formatted message to out.
+   \param time when the message was logged, if not now (records kept by CLogger::SetBacktrace())
+   */
+  void AppendString(std::string &out, int level, const CLogThreadInfo &thread, const char *str, size_t length,
+                    const CLogTime *time = NULL);
+  /*! \brief Append only the arguments of a Log() call, encoded as in a MESSAGE record, to be formatted
+   later with CBinaryLogReader::FormatArguments() (see CLogger::SetBacktrace()). Nothing is added to the dictionary.
+   \return false (and out untouched) if the format can't be captured
+   */
+  bool AppendArguments(std::string &out, const char *format, va_list args);
+
+private:
+  struct CFormat
+  {
+    uint32_t id;
+    bool capturable;
+    std::vector<unsigned char> kinds; // per argument, '*' arguments are INT
+    std::vector<int> precisions;      // per argument, see CBinaryLogSpec::precision
+  };
+
+  void AppendHeader(std::string &out, int type, int level, const CLogThreadInfo &thread, const CLogTime *time = NULL);
+  const CFormat& GetFormat(std::string &out, const char *format);
+  // the entry for format, added is set if it is not in the dictionary yet
+  CFormat& FindFormat(const char *format, bool &added);
+  typedef std::unordered_map<std::string, CFormat> CFormatTexts;
+  static void AppendValues(std::string &out, const CFormat &entry, va_list args);
+
+  CFormatTexts m_formatTexts;                         // the dictionary, by text
+  std::unordered_map<const char*, CFormatTexts::value_type*> m_formats; // by address, format strings are mostly literals
+  std::vector<unsigned int> m_threads;                // per thread index: 1 + name version already written
+  std::vector<unsigned int> m_threadContexts;         // per thread index: 1 + context version already written, 0 to write it again
+  std::unordered_map<std::string, uint32_t> m_contexts; // context text to id
+  int64_t m_lastTime;                                 // microseconds since the epoch of the last record
+  int64_t m_lastSecond;
+  uint32_t m_nextFormatId;
+};
+
+class CBinaryLogReader
+{
+public:
+  CBinaryLogReader();
+
+  /*! \brief Start reading a binary log held in memory.
+   \return false if it doesn't start with a binary log header
+   */
+  bool Open(const char *data, size_t size);
+
+  /*! \brief Decode the next record into exactly the text the text log would have for it:
+   prefix, continuation line indentation, "Previous line repeats" records, no line end.
+   \param time receives the record time in microseconds since the epoch
+   \return false at the end of the data, or at a record that was cut short (a crash while writing)
+   */
+  bool NextRecord(std::string &text, int64_t *time = NULL);
+
+  /*! \brief Format arguments stored by CBinaryLogWriter::AppendArguments().
+   \return false if they don't match the format
+   */
+  static bool FormatArguments(const char *format, const std::string &arguments, std::string &text);
+
+  /*! \brief Number of bytes consumed, after NextRecord() returned false this is where decoding stopped. */
+  size_t GetPosition() const { return m_pos - m_data; }
+  bool IsAtEnd() const { return m_pos == m_end; }
+
+private:
+  // decode the next MESSAGE or STRING record, handling the other records in between
+  bool NextMessage(int &level, unsigned int &thread, std::string &text);
+  bool ReadVarint(uint64_t &value);
+  bool ReadSigned(int64_t &value);
+  bool ReadBytes(const char *&bytes, size_t length);
+  bool FormatMessage(const char *format, std::string &text);
+  void AppendRecord(std::string &out, int level, unsigned int thread, bool withContext, const char *text, size_t length);
+  uint32_t GetThreadContext(unsigned int thread) const;
+
+  const char *m_data;
+  const char *m_pos;
+  const char *m_end;
+  int64_t m_time;
+  int m_localTime[6];                     // CLogTime fields
+  std::vector<std::string> m_formats;
+  std::vector<std::string> m_threadNames;
+  std::vector<std::string> m_contexts;    // by id, 0 is the empty context
+  std::vector<uint32_t> m_threadContexts; // context id per thread
+
+  // CLog::LogString() state
+  std::string m_repeatLine;
+  int m_repeatLogLevel;
+  int m_repeatCount;
+  unsigned int m_lastThread;
+  uint32_t m_repeatContext;
+  std::string m_pending; // a record to return after the "Previous line repeats" record
+  int64_t m_pendingTime;
+};
@@ -0,0 +1,275 @@
+#include "FuzzyIndex.h"
+#include <algorithm>
+#include <queue>
+#include <thread>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define popcount64(x) ((int)__popcnt64(x))
+#else
+#define popcount64(x) __builtin_popcountll(x)
+#endif
+
+/*!
+ Per-thread working memory for a lookup, so batch lookups don't allocate per query.
+ Also holds the query compiled for the bit-parallel LCS (Hyyro's variant of
+ Allison-Dix): one bit per query character, one mask per byte value.
+ */
+class CFuzzyIndex::CScratch
+{
+public:
+  std::vector<uint32_t> counts;
+  std::vector<uint32_t> touched;
+  std::vector<uint32_t> trigrams;
+  std::vector<uint64_t> masks; // masks[byte * words + w]
+  std::vector<uint64_t> v;
+  size_t words;
+  size_t length;
+
+  void Compile(const std::string &query)
+  {
+    length = query.size();
+    words = (length + 63) / 64;
+    if (words == 0)
+      words = 1;
+    masks.assign(256 * words, 0);
+    for (size_t i = 0; i < length; i++)
+      masks[(unsigned char)query[i] * words + i / 64] |= (uint64_t)1 << (i % 64);
+    v.resize(words);
+  }
+
+  // length of the longest common subsequence of the compiled query and str
+  size_t LongestCommonSubsequence(const std::string &str)
+  {
+    if (length == 0 || str.empty())
+      return 0;
+
+    std::fill(v.begin(), v.end(), ~(uint64_t)0);
+    for (size_t i = 0; i < str.size(); i++)
+    {
+      const uint64_t *m = &masks[(unsigned char)str[i] * words];
+      uint64_t carry = 0;
+      for (size_t w = 0; w < words; w++)
+      {
+        const uint64_t u = v[w] & m[w];
+        const uint64_t sum = v[w] + u + carry;
+        carry = (sum < v[w] || (carry && sum == v[w])) ? 1 : 0;
+        v[w] = sum | (v[w] - u);
+      }
+    }
+
+    size_t zeros = 0;
+    for (size_t w = 0; w < words; w++)
+    {
+      uint64_t bits = ~v[w];
+      if (w == words - 1 && length % 64)
+        bits &= ((uint64_t)1 << (length % 64)) - 1;
+      zeros += popcount64(bits);
+    }
+    return zeros;
+  }
+};
+
+// higher score first, list order for equal scores; keeps the worst match on top of the heap
+struct BetterMatch
+{
+  bool operator()(const CFuzzyIndex::Match &a, const CFuzzyIndex::Match &b) const
+  {
+    if (a.score != b.score)
+      return a.score > b.score;
+    return a.index < b.index;
+  }
+};
+
+CFuzzyIndex::CFuzzyIndex()
+{
+}
+
+CFuzzyIndex::CFuzzyIndex(const std::vector<std::string> &strings)
+{
+  Build(strings);
+}
+
+void CFuzzyIndex::GetTrigrams(const std::string &str, std::vector<uint32_t> &trigrams)
+{
+  // pad with two leading and one trailing zero byte, so short strings get trigrams
+  // too and the start of a string weighs a bit more
+  trigrams.clear();
+  uint32_t gram = 0;
+  for (size_t i = 0; i <= str.size(); i++)
+  {
+    const unsigned char ch = i < str.size() ? (unsigned char)str[i] : 0;
+    gram = ((gram << 8) | ch) & 0xFFFFFF;
+    trigrams.push_back(gram);
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+void CFuzzyIndex::Build(const std::vector<std::string> &strings)
+{
+  m_strings = strings;
+
+  std::vector<std::pair<uint32_t, uint32_t> > pairs;
+  std::vector<uint32_t> trigrams;
+  for (size_t i = 0; i < m_strings.size(); i++)
+  {
+    GetTrigrams(m_strings[i], trigrams);
+    for (size_t j = 0; j < trigrams.size(); j++)
+      pairs.push_back(std::make_pair(trigrams[j], (uint32_t)i));
+  }
+  std::sort(pairs.begin(), pairs.end());
+
+  m_trigrams.clear();
+  m_postStart.clear();
+  m_postings.clear();
+  m_postings.reserve(pairs.size());
+  for (size_t i = 0; i < pairs.size(); i++)
+  {
+    if (m_trigrams.empty() || m_trigrams.back() != pairs[i].first)
+    {
+      m_trigrams.push_back(pairs[i].first);
+      m_postStart.push_back((uint32_t)i);
+    }
+    m_postings.push_back(pairs[i].second);
+  }
+  m_postStart.push_back((uint32_t)m_postings.size());
+}
+
+int CFuzzyIndex::FindBestMatch(const std::string &str, double &matchscore) const
+{
+  std::vector<Match> matches = FindBestMatches(str, 1);
+  if (matches.empty())
+  {
+    matchscore = 0;
+    return -1;
+  }
+  matchscore = matches[0].score;
+  return matches[0].index;
+}
+
+std::vector<CFuzzyIndex::Match> CFuzzyIndex::FindBestMatches(const std::string &str, size_t count, size_t maxCandidates /* = 0 */) const
+{
+  CScratch scratch;
+  std::vector<Match> matches;
+  Search(str, count, maxCandidates, scratch, matches);
+  return matches;
+}
+
+void CFuzzyIndex::FindBestMatches(const std::vector<std::string> &queries, size_t count,
+                                  std::vector<std::vector<Match> > &results, unsigned int threads /* = 0 */, size_t maxCandidates /* = 0 */) const
+{
+  results.clear();
+  results.resize(queries.size());
+
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if (threads > queries.size())
+    threads = (unsigned int)queries.size();
+  if (threads <= 1)
+  {
+    CScratch scratch;
+    for (size_t i = 0; i < queries.size(); i++)
+      Search(queries[i], count, maxCandidates, scratch, results[i]);
+    return;
+  }
+
+  // interleave the queries so that expensive ones (long, common trigrams) tend to spread out
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t < threads; t++)
+  {
+    workers.push_back(std::thread([this, &queries, &results, count, maxCandidates, t, threads]()
+    {
+      CScratch scratch;
+      for (size_t i = t; i < queries.size(); i += threads)
+        Search(queries[i], count, maxCandidates, scratch, results[i]);
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+}
+
+void CFuzzyIndex::Search(const std::string &str, size_t count, size_t maxCandidates, CScratch &scratch, std::vector<Match> &matches) const
+{
+  matches.clear();
+  if (count == 0 || m_strings.empty())
+    return;
+
+  // count the trigrams each string shares with the query
+  if (scratch.counts.size() != m_strings.size())
+    scratch.counts.assign(m_strings.size(), 0);
+  scratch.touched.clear();
+  GetTrigrams(str, scratch.trigrams);
+  for (size_t i = 0; i < scratch.trigrams.size(); i++)
+  {
+    std::vector<uint32_t>::const_iterator it = std::lower_bound(m_trigrams.begin(), m_trigrams.end(), scratch.trigrams[i]);
+    if (it == m_trigrams.end() || *it != scratch.trigrams[i])
+      continue;
+    const size_t slot = it - m_trigrams.begin();
+    for (uint32_t p = m_postStart[slot]; p < m_postStart[slot + 1]; p++)
+    {
+      const uint32_t id = m_postings[p];
+      if (scratch.counts[id]++ == 0)
+        scratch.touched.push_back(id);
+    }
+  }
+
+  // most shared trigrams first, so the length bound below kicks in early
+  std::vector<std::pair<int, uint32_t> > candidates;
+  candidates.reserve(scratch.touched.size());
+  for (size_t i = 0; i < scratch.touched.size(); i++)
+  {
+    const uint32_t id = scratch.touched[i];
+    candidates.push_back(std::make_pair(-(int)scratch.counts[id], id));
+    scratch.counts[id] = 0;
+  }
+  // trigrams say little about a query shorter than one, and nothing if none is shared: score every string
+  if (str.size() < 3 || candidates.empty())
+  {
+    candidates.clear();
+    for (size_t i = 0; i < m_strings.size(); i++)
+      candidates.push_back(std::make_pair(0, (uint32_t)i));
+  }
+  if (maxCandidates && candidates.size() > maxCandidates)
+  {
+    std::nth_element(candidates.begin(), candidates.begin() + maxCandidates, candidates.end());
+    candidates.resize(maxCandidates);
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  scratch.Compile(str);
+  std::priority_queue<Match, std::vector<Match>, BetterMatch> best;
+  for (size_t i = 0; i < candidates.size(); i++)
+  {
+    const uint32_t id = candidates[i].second;
+    const std::string &candidate = m_strings[id];
+    int maxlength = (int)std::max(str.size(), candidate.size());
+    if (maxlength == 0)
+      maxlength = 1;
+    if (best.size() == count)
+    {
+      // the LCS can't be longer than the shorter string
+      const double bound = ((double)std::min(str.size(), candidate.size()) + 0.25) / maxlength;
+      if (bound < best.top().score)
+        continue;
+    }
+
+    Match match;
+    match.index = (int)id;
+    match.score = ((double)scratch.LongestCommonSubsequence(candidate) + 0.25) / maxlength;
+    if (best.size() < count)
+      best.push(match);
+    else if (BetterMatch()(match, best.top()))
+    {
+      best.pop();
+      best.push(match);
+    }
+  }
+
+  matches.resize(best.size());
+  for (size_t i = matches.size(); i > 0; i--)
+  {
+    matches[i - 1] = best.top();
+    best.pop();
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*!
+ \brief Index over a (large) list of strings for repeated fuzzy lookups.
+
+ StringUtils::FindBestMatch() scores the query against every string in the
+ list. This class builds a trigram inverted index once, so a lookup only
+ scores strings that share at least one trigram with the query, best
+ candidates first, and skips the ones whose length alone rules them out.
+ Queries shorter than three characters, and queries that share no trigram
+ with any string, are scored against every string instead.
+
+ Scores are computed the same way as in FindBestMatch():
+ StringUtils::CompareFuzzy(query, candidate) / max(query length, candidate length).
+ Otherwise, a string that has no trigram in common with the query is never
+ returned, even if its score would be higher than that of the strings
+ that do share one.
+
+ The index is immutable once built, lookups are const and thread safe.
+ */
+class CFuzzyIndex
+{
+public:
+  struct Match
+  {
+    int index;    //!< position in the list the index was built from
+    double score; //!< normalized score, see class description
+  };
+
+  CFuzzyIndex();
+  explicit CFuzzyIndex(const std::vector<std::string> &strings);
+
+  void Build(const std::vector<std::string> &strings);
+  size_t Size() const { return m_strings.size(); }
+  const std::string& Get(int index) const { return m_strings[index]; }
+
+  /*! \brief Like StringUtils::FindBestMatch(), over the strings considered (see the class description).
+   \return index of the best matching string or -1 if the index is empty
+   */
+  int FindBestMatch(const std::string &str, double &matchscore) const;
+
+  /*! \brief Find the best matches for str.
+   \param str the query
+   \param count maximum number of matches to return
+   \param maxCandidates if not 0, only score this many candidates (those sharing most trigrams with str)
+   \return up to count matches, best first, ties in list order
+   */
+  std::vector<Match> FindBestMatches(const std::string &str, size_t count, size_t maxCandidates = 0) const;
+
+  /*! \brief Batch version of FindBestMatches(), the queries are spread over several threads.
+   \param threads number of threads to use, 0 to use one per CPU core
+   */
+  void FindBestMatches(const std::vector<std::string> &queries, size_t count,
+                       std::vector<std::vector<Match> > &results, unsigned int threads = 0, size_t maxCandidates = 0) const;
+
+private:
+  class CScratch;
+  void Search(const std::string &str, size_t count, size_t maxCandidates, CScratch &scratch, std::vector<Match> &matches) const;
+  static void GetTrigrams(const std::string &str, std::vector<uint32_t> &trigrams);
+
+  std::vector<std::string> m_strings;
+  std::vector<uint32_t> m_trigrams;  // sorted distinct trigrams
+  std::vector<uint32_t> m_postStart; // postings of m_trigrams[i] are m_postings[m_postStart[i] .. m_postStart[i+1]]
+  std::vector<uint32_t> m_postings;  // string indexes, ascending per trigram
+};
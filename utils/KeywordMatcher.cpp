@@ -0,0 +1,241 @@
+#include "KeywordMatcher.h"
+#include <string.h>
+
+// defined in StringUtils.cpp, returns the length of the utf8 letter at str or -1
+int IsUTF8Letter(const unsigned char *str);
+
+static inline unsigned char FoldByte(unsigned char ch, bool ignoreCase)
+{
+  if (ignoreCase && ch >= 'A' && ch <= 'Z')
+    return ch + ('a' - 'A');
+  return ch;
+}
+
+static inline int LetterLength(const unsigned char *s, const unsigned char *end)
+{
+  // IsUTF8Letter() looks at the byte after a lead byte, don't let it leave the buffer
+  if (s >= end || ((*s & 0x80) && s + 1 >= end))
+    return -1;
+  return IsUTF8Letter(s);
+}
+
+// Same word skipping as StringUtils::FindWords: skip a number, a run of
+// (latin) letters or a single other character, then any following spaces.
+// Returns the next position a word-start keyword may be tried at.
+static size_t NextWordStart(const unsigned char *str, size_t length, size_t pos)
+{
+  const unsigned char *s = str + pos;
+  const unsigned char *end = str + length;
+  int l;
+  if (*s >= '0' && *s <= '9')
+  {
+    ++s;
+    while (s < end && *s >= '0' && *s <= '9') ++s;
+  }
+  else if ((l = LetterLength(s, end)) > 0)
+  {
+    s += l;
+    while ((l = LetterLength(s, end)) > 0) s += l;
+  }
+  else
+    ++s;
+  while (s < end && *s == ' ') s++;
+
+  return s - str;
+}
+
+CKeywordMatcher::CKeywordMatcher() :
+  m_classCount(1), m_keywordCount(0), m_maxLength(0), m_emptyKeyword(-1),
+  m_ignoreCase(false), m_mode(MATCH_ANYWHERE)
+{
+  memset(m_class, 0, sizeof(m_class));
+}
+
+CKeywordMatcher::CKeywordMatcher(const std::vector<std::string> &keywords, bool ignoreCase /* = false */, MatchMode mode /* = MATCH_ANYWHERE */) :
+  m_classCount(1), m_keywordCount(0), m_maxLength(0), m_emptyKeyword(-1),
+  m_ignoreCase(false), m_mode(MATCH_ANYWHERE)
+{
+  Build(keywords, ignoreCase, mode);
+}
+
+void CKeywordMatcher::Build(const std::vector<std::string> &keywords, bool ignoreCase /* = false */, MatchMode mode /* = MATCH_ANYWHERE */)
+{
+  m_ignoreCase = ignoreCase;
+  m_mode = mode;
+  m_keywordCount = keywords.size();
+  m_maxLength = 0;
+  m_emptyKeyword = -1;
+
+  // map every byte used by a keyword to its own input class, everything else to class 0
+  memset(m_class, 0, sizeof(m_class));
+  m_classCount = 1;
+  size_t totalLength = 0;
+  for (size_t i = 0; i < keywords.size(); i++)
+  {
+    const std::string &keyword = keywords[i];
+    totalLength += keyword.size();
+    if (keyword.size() > m_maxLength)
+      m_maxLength = keyword.size();
+    for (size_t j = 0; j < keyword.size(); j++)
+    {
+      const unsigned char ch = FoldByte(keyword[j], ignoreCase);
+      if (m_class[ch] == 0)
+        m_class[ch] = (uint16_t)m_classCount++;
+    }
+  }
+  if (ignoreCase)
+  {
+    for (unsigned int ch = 'A'; ch <= 'Z'; ch++)
+      m_class[ch] = m_class[ch + ('a' - 'A')];
+  }
+
+  // build the trie, an edge to state 0 means "no edge" as nothing goes back to the root
+  m_next.assign(m_classCount, 0);
+  m_output.assign(1, -1);
+  m_depth.assign(1, 0);
+  m_next.reserve((totalLength + 1) * m_classCount);
+  for (size_t i = 0; i < keywords.size(); i++)
+  {
+    const std::string &keyword = keywords[i];
+    if (keyword.empty())
+    {
+      if (m_emptyKeyword < 0)
+        m_emptyKeyword = (int)i;
+      continue;
+    }
+
+    uint32_t state = 0;
+    for (size_t j = 0; j < keyword.size(); j++)
+    {
+      const unsigned int cls = m_class[FoldByte(keyword[j], ignoreCase)];
+      uint32_t next = m_next[state * m_classCount + cls];
+      if (next == 0)
+      {
+        next = (uint32_t)m_output.size();
+        m_next[state * m_classCount + cls] = next;
+        m_next.resize(m_next.size() + m_classCount, 0);
+        m_output.push_back(-1);
+        m_depth.push_back(m_depth[state] + 1);
+      }
+      state = next;
+    }
+    if (m_output[state] < 0) // first one wins for duplicates
+      m_output[state] = (int32_t)i;
+  }
+
+  // breadth first: compute failure links and fill in the missing transitions,
+  // which turns the trie into a DFA
+  const size_t stateCount = m_output.size();
+  std::vector<uint32_t> fail(stateCount, 0);
+  std::vector<uint32_t> queue;
+  queue.reserve(stateCount);
+  m_outLink.assign(stateCount, 0);
+
+  for (unsigned int cls = 0; cls < m_classCount; cls++)
+  {
+    const uint32_t child = m_next[cls];
+    if (child != 0)
+      queue.push_back(child);
+  }
+  for (size_t head = 0; head < queue.size(); head++)
+  {
+    const uint32_t state = queue[head];
+    const uint32_t *failRow = &m_next[fail[state] * m_classCount];
+    uint32_t *row = &m_next[state * m_classCount];
+    for (unsigned int cls = 0; cls < m_classCount; cls++)
+    {
+      const uint32_t child = row[cls];
+      if (child != 0)
+      {
+        fail[child] = failRow[cls];
+        queue.push_back(child);
+      }
+      else
+        row[cls] = failRow[cls];
+    }
+    const uint32_t f = fail[state];
+    m_outLink[state] = m_output[f] >= 0 ? f : m_outLink[f];
+  }
+}
+
+size_t CKeywordMatcher::Find(const char *str, size_t length, int *keywordIndex /* = NULL */) const
+{
+  return Scan(str, length, false, keywordIndex);
+}
+
+bool CKeywordMatcher::Contains(const char *str, size_t length) const
+{
+  return Scan(str, length, true, NULL) != std::string::npos;
+}
+
+size_t CKeywordMatcher::Scan(const char *str, size_t length, bool firstHit, int *keywordIndex) const
+{
+  if (m_emptyKeyword >= 0)
+  { // an empty keyword matches at the very beginning, both for find() and FindWords()
+    if (keywordIndex)
+      *keywordIndex = m_emptyKeyword;
+    return 0;
+  }
+  if (m_keywordCount == 0 || length == 0)
+    return std::string::npos;
+
+  const unsigned char *s = (const unsigned char *)str;
+  const bool wordStart = m_mode == MATCH_WORD_START;
+
+  // For word-start matching we need to know, for a keyword ending here, whether it
+  // started at a word boundary. Keep that as a bit history of the last 64 positions
+  // (bit n set = position i-n was a word start), or as a flag per byte for longer keywords.
+  uint64_t startHistory = 0;
+  std::vector<unsigned char> startFlags;
+  if (wordStart && m_maxLength > 64)
+    startFlags.resize(length, 0);
+  size_t nextStart = 0;
+
+  size_t best = std::string::npos;
+  int bestKeyword = -1;
+  uint32_t state = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    // nothing ending from here on can start before the best match we have
+    if (best != std::string::npos && i >= best + m_maxLength)
+      break;
+
+    if (wordStart)
+    {
+      const bool isStart = i == nextStart;
+      if (isStart)
+        nextStart = NextWordStart(s, length, i);
+      startHistory = (startHistory << 1) | (isStart ? 1 : 0);
+      if (!startFlags.empty())
+        startFlags[i] = isStart;
+    }
+
+    state = m_next[state * m_classCount + m_class[s[i]]];
+
+    // walk all keywords ending at i, longest first
+    for (uint32_t out = m_output[state] >= 0 ? state : m_outLink[state]; out != 0; out = m_outLink[out])
+    {
+      const size_t len = m_depth[out];
+      const size_t start = i + 1 - len;
+      if (wordStart)
+      {
+        const bool startedAtWord = startFlags.empty() ? ((startHistory >> (len - 1)) & 1) != 0 : startFlags[start] != 0;
+        if (!startedAtWord)
+          continue;
+      }
+      if (start < best)
+      {
+        best = start;
+        bestKeyword = m_output[out];
+      }
+      break; // shorter ones on the chain start later
+    }
+
+    if (firstHit && best != std::string::npos)
+      break;
+  }
+
+  if (keywordIndex && best != std::string::npos)
+    *keywordIndex = bestKeyword;
+  return best;
+}
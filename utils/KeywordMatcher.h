@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*!
+ \brief A set of keywords compiled once and then searched for in a single pass.
+
+ The keywords are turned into an Aho-Corasick automaton with the transition
+ table fully expanded (one lookup per input byte, no failure-link walking at
+ search time). Bytes that don't appear in any keyword share one input class,
+ so the table stays small even for blocklists of several hundred terms.
+
+ Build it once and reuse it; searching is const and may be done from several
+ threads at the same time.
+
+ \sa StringUtils::ContainsKeyword, StringUtils::FindWords
+ */
+class CKeywordMatcher
+{
+public:
+  enum MatchMode
+  {
+    MATCH_ANYWHERE,   //!< a keyword may start at any byte, like std::string::find
+    MATCH_WORD_START  //!< a keyword must start where StringUtils::FindWords would try it
+  };
+
+  CKeywordMatcher();
+  CKeywordMatcher(const std::vector<std::string> &keywords, bool ignoreCase = false, MatchMode mode = MATCH_ANYWHERE);
+
+  /*! \brief (Re)compile the matcher from the given keywords.
+   \param keywords the keywords to look for, duplicates are allowed
+   \param ignoreCase fold US-ASCII letters on both the keywords and the searched text
+   \param mode where in the text a keyword is allowed to start
+   */
+  void Build(const std::vector<std::string> &keywords, bool ignoreCase = false, MatchMode mode = MATCH_ANYWHERE);
+
+  bool IsEmpty() const { return m_keywordCount == 0; }
+  size_t GetKeywordCount() const { return m_keywordCount; }
+
+  /*! \brief Find the left-most occurrence of any keyword.
+   \param str text to search, doesn't need to be zero-terminated
+   \param length number of bytes in str
+   \param keywordIndex (optional) receives the index of the matched keyword in the
+          list given to Build(); for several keywords at the same position the shortest wins
+   \return offset of the match in str, or std::string::npos if nothing matched
+   */
+  size_t Find(const char *str, size_t length, int *keywordIndex = NULL) const;
+  size_t Find(const std::string &str, int *keywordIndex = NULL) const { return Find(str.data(), str.size(), keywordIndex); }
+
+  /*! \brief Check if any keyword occurs in the text, stops at the first hit. */
+  bool Contains(const char *str, size_t length) const;
+  bool Contains(const std::string &str) const { return Contains(str.data(), str.size()); }
+
+private:
+  size_t Scan(const char *str, size_t length, bool firstHit, int *keywordIndex) const;
+
+  std::vector<uint32_t> m_next;    // m_next[state * m_classCount + class], state 0 is the root
+  std::vector<int32_t>  m_output;  // index of the keyword ending in state, -1 if none
+  std::vector<uint32_t> m_outLink; // next state on the suffix chain with an output, 0 if none
+  std::vector<uint32_t> m_depth;   // length of the path from the root to state
+  uint16_t m_class[256];  // up to 257 classes, 0 for bytes in no keyword
+  unsigned int m_classCount;
+  size_t m_keywordCount;
+  size_t m_maxLength;
+  int m_emptyKeyword;              // index of an empty keyword (matches at 0), -1 if none
+  bool m_ignoreCase;
+  MatchMode m_mode;
+};
@@ -0,0 +1,163 @@
+#include "LogFormat.h"
+
+CLogFormatProgram::CLogFormatProgram(const char* format)
+{
+  for (const char* p = format;;)
+  {
+    // the literal up to the next conversion, with "%%" as "%"
+    const char* conversion = CLogFormat::NextConversion(p);
+    while (p < conversion)
+    {
+      const char* percent = p;
+      while (percent < conversion && *percent != '%')
+        percent++;
+      COp literal = { OP_LITERAL, CLogFormat::LEN_NONE, 0, false, p, (size_t)(percent - p), 0 };
+      if (percent < conversion)
+        literal.textLength++; // the first of "%%"
+      m_ops.push_back(literal);
+      p = percent < conversion ? percent + 2 : conversion;
+    }
+    if (*conversion == 0)
+      break;
+
+    // the format was checked when compiling, see CLogFormatChecker
+    const char* flags = CLogFormat::SkipFlags(conversion + 1);
+    const char* q = flags;
+    COp star = { OP_STAR, CLogFormat::LEN_NONE, '*', false, NULL, 0, 0 };
+    if (*q == '*')
+    {
+      m_ops.push_back(star);
+      q++;
+    }
+    else
+      q = CLogFormat::SkipDigits(q);
+    if (*q == '.')
+    {
+      if (q[1] == '*')
+      {
+        m_ops.push_back(star);
+        q += 2;
+      }
+      else
+        q = CLogFormat::SkipDigits(q + 1);
+    }
+    COp value = { OP_VALUE, (unsigned char)CLogFormat::LengthOf(q), q[CLogFormat::LengthChars(q)], q == conversion + 1, NULL, 0, m_specs.size() };
+    p = q + CLogFormat::LengthChars(q) + (value.conversion ? 1 : 0);
+    m_specs.append(conversion, p).append(1, '\0');
+    m_ops.push_back(value);
+  }
+}
+
+size_t CLogFormatProgram::AppendLiterals(CStringBuilder& out, size_t op) const
+{
+  for (; op < m_ops.size() && m_ops[op].kind == OP_LITERAL; op++)
+    out.Append(m_ops[op].text, m_ops[op].textLength);
+  return op;
+}
+
+CStringBuilder& CLogFormatProgram::GetThreadBuffer()
+{
+  static thread_local CStringBuilder buffer;
+  return buffer;
+}
+
+// snprintf of one conversion, with its '*' values
+template<typename V>
+static void AppendConversion(CStringBuilder& out, const char* spec, const int* stars, unsigned int starCount, V value)
+{
+  if (starCount == 0)
+    out.AppendFormat(spec, value);
+  else if (starCount == 1)
+    out.AppendFormat(spec, stars[0], value);
+  else
+    out.AppendFormat(spec, stars[0], stars[1], value);
+}
+
+void CLogFormatProgram::ApplyInteger(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, uint64_t value) const
+{
+  const bool isSigned = slot.conversion == 'd' || slot.conversion == 'i';
+  // the value as the type the conversion takes
+  int64_t signedValue;
+  uint64_t unsignedValue;
+  switch (slot.length)
+  {
+  case CLogFormat::LEN_LONG:     signedValue = (long)value; unsignedValue = (unsigned long)value; break;
+  case CLogFormat::LEN_LONGLONG: signedValue = (long long)value; unsignedValue = (unsigned long long)value; break;
+  case CLogFormat::LEN_INTMAX:   signedValue = (intmax_t)value; unsignedValue = (uintmax_t)value; break;
+  case CLogFormat::LEN_SIZE:     signedValue = (ptrdiff_t)(size_t)value; unsignedValue = (size_t)value; break;
+  case CLogFormat::LEN_PTRDIFF:  signedValue = (ptrdiff_t)value; unsignedValue = (size_t)(ptrdiff_t)value; break;
+  case CLogFormat::LEN_CHAR:     signedValue = (signed char)value; unsignedValue = (unsigned char)value; break;
+  case CLogFormat::LEN_SHORT:    signedValue = (short)value; unsignedValue = (unsigned short)value; break;
+  default:                       signedValue = (int)value; unsignedValue = (unsigned int)value; break;
+  }
+
+  if (slot.plain && isSigned)
+    out.AppendInteger(signedValue);
+  else if (slot.plain && slot.conversion == 'u')
+    out.AppendUnsigned(unsignedValue);
+  else if (slot.plain && slot.conversion == 'c')
+    out.Append((char)signedValue);
+  else
+  {
+    const char* spec = m_specs.c_str() + slot.spec;
+    switch (slot.length)
+    {
+    case CLogFormat::LEN_LONG:
+      if (isSigned)
+        AppendConversion(out, spec, stars, starCount, (long)signedValue);
+      else
+        AppendConversion(out, spec, stars, starCount, (unsigned long)unsignedValue);
+      break;
+    case CLogFormat::LEN_LONGLONG:
+      if (isSigned)
+        AppendConversion(out, spec, stars, starCount, (long long)signedValue);
+      else
+        AppendConversion(out, spec, stars, starCount, (unsigned long long)unsignedValue);
+      break;
+    case CLogFormat::LEN_INTMAX:
+      if (isSigned)
+        AppendConversion(out, spec, stars, starCount, (intmax_t)signedValue);
+      else
+        AppendConversion(out, spec, stars, starCount, (uintmax_t)unsignedValue);
+      break;
+    case CLogFormat::LEN_SIZE:
+    case CLogFormat::LEN_PTRDIFF:
+      if (isSigned)
+        AppendConversion(out, spec, stars, starCount, (ptrdiff_t)signedValue);
+      else
+        AppendConversion(out, spec, stars, starCount, (size_t)unsignedValue);
+      break;
+    default: // char and short are passed as int
+      if (isSigned || slot.conversion == 'c')
+        AppendConversion(out, spec, stars, starCount, (int)signedValue);
+      else
+        AppendConversion(out, spec, stars, starCount, (unsigned int)unsignedValue);
+      break;
+    }
+  }
+}
+
+void CLogFormatProgram::ApplyDouble(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, double value) const
+{
+  AppendConversion(out, m_specs.c_str() + slot.spec, stars, starCount, value);
+}
+
+void CLogFormatProgram::ApplyLongDouble(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, long double value) const
+{
+  AppendConversion(out, m_specs.c_str() + slot.spec, stars, starCount, value);
+}
+
+void CLogFormatProgram::ApplyString(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const char* value) const
+{
+  if (slot.conversion == 'p')
+    ApplyPointer(out, slot, stars, starCount, value);
+  else if (slot.plain)
+    out.Append(value ? value : "(null)");
+  else
+    AppendConversion(out, m_specs.c_str() + slot.spec, stars, starCount, value);
+}
+
+void CLogFormatProgram::ApplyPointer(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const void* value) const
+{
+  AppendConversion(out, m_specs.c_str() + slot.spec, stars, starCount, value);
+}
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "log.h"
+
+/*!
+ \brief Checked printf-style logging: clog_info("%s took %d ms", name, ms).
+
+ The format string has to be a literal. Its conversions are matched against the argument
+ types when compiling (a static_assert fails for a wrong count, a mismatched type such as a
+ std::string for %s or a long long for %d, and for %n, %ls or positional arguments).
+ Each call site parses its format once, the first time it logs, into a CLogFormatProgram:
+ the literal pieces and one slot per argument. Logging then copies the pieces and converts
+ the arguments in order, the plain conversions (%d, %u, %lld, %zu, %s, %c ...) without going
+ through printf at all, the others with one snprintf each.
+
+ The arguments are only evaluated when the level is logged. Records below the level are not
+ kept for CLog::SetBacktrace().
+ */
+
+struct CLogFormat
+{
+  enum Result { OK, BAD_TYPE, TOO_FEW_ARGUMENTS, TOO_MANY_ARGUMENTS, UNSUPPORTED };
+  enum Length { LEN_NONE, LEN_CHAR, LEN_SHORT, LEN_LONG, LEN_LONGLONG, LEN_INTMAX, LEN_SIZE, LEN_PTRDIFF, LEN_LONGDOUBLE };
+  enum ArgClass { ARG_INTEGER, ARG_DOUBLE, ARG_LONGDOUBLE, ARG_STRING, ARG_POINTER, ARG_OTHER };
+
+  // C++11 constexpr, one return statement each; they are used at run time too
+
+  /* the '%' of the next conversion, or the terminating NUL; "%%" is skipped */
+  static constexpr const char* NextConversion(const char* p)
+  {
+    return IsStop(p[0]) ? Resolve(p) : IsStop(p[1]) ? Resolve(p + 1) : IsStop(p[2]) ? Resolve(p + 2) :
+           IsStop(p[3]) ? Resolve(p + 3) : NextConversion(p + 4); // four at a time, for the recursion depth
+  }
+  static constexpr bool IsStop(char c) { return c == 0 || c == '%'; }
+  static constexpr const char* Resolve(const char* p) { return *p == 0 || p[1] != '%' ? p : NextConversion(p + 2); }
+
+  static constexpr const char* SkipFlags(const char* p)
+  {
+    return *p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'' ? SkipFlags(p + 1) : p;
+  }
+  static constexpr const char* SkipDigits(const char* p) { return *p >= '0' && *p <= '9' ? SkipDigits(p + 1) : p; }
+  /* "%1$d", p is after the '%' */
+  static constexpr bool IsPositional(const char* p) { return SkipDigits(p) != p && *SkipDigits(p) == '$'; }
+
+  static constexpr int LengthOf(const char* p)
+  {
+    return *p == 'h' ? (p[1] == 'h' ? LEN_CHAR : LEN_SHORT) : *p == 'l' ? (p[1] == 'l' ? LEN_LONGLONG : LEN_LONG) :
+           *p == 'q' ? LEN_LONGLONG : *p == 'j' ? LEN_INTMAX : *p == 'z' ? LEN_SIZE : *p == 't' ? LEN_PTRDIFF :
+           *p == 'L' ? LEN_LONGDOUBLE : LEN_NONE;
+  }
+  static constexpr int LengthChars(const char* p)
+  {
+    return (*p == 'h' && p[1] == 'h') || (*p == 'l' && p[1] == 'l') ? 2 : LengthOf(p) != LEN_NONE ? 1 : 0;
+  }
+  /* the size of the integer an integer conversion takes, 0 for none */
+  static constexpr size_t IntegerSize(int length)
+  {
+    return length == LEN_NONE || length == LEN_CHAR || length == LEN_SHORT ? sizeof(int) : length == LEN_LONG ? sizeof(long) :
+           length == LEN_LONGLONG ? sizeof(long long) : length == LEN_INTMAX ? sizeof(intmax_t) :
+           length == LEN_SIZE ? sizeof(size_t) : length == LEN_PTRDIFF ? sizeof(ptrdiff_t) : 0;
+  }
+  static constexpr bool IsIntegerConversion(char c)
+  {
+    return c == 'd' || c == 'i' || c == 'u' || c == 'o' || c == 'x' || c == 'X';
+  }
+  static constexpr bool IsFloatConversion(char c)
+  {
+    return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A';
+  }
+
+  /* can an argument of class argClass and (promoted) argSize be converted by length and conversion */
+  static constexpr int Match(int argClass, size_t argSize, int length, char conversion)
+  {
+    return IsIntegerConversion(conversion) ?
+             (length == LEN_LONGDOUBLE ? UNSUPPORTED : argClass == ARG_INTEGER && argSize == IntegerSize(length) ? OK : BAD_TYPE) :
+           IsFloatConversion(conversion) ?
+             (length == LEN_LONGDOUBLE ? (argClass == ARG_LONGDOUBLE ? OK : BAD_TYPE) :
+              length == LEN_NONE || length == LEN_LONG ? (argClass == ARG_DOUBLE ? OK : BAD_TYPE) : UNSUPPORTED) :
+           conversion == 'c' ?
+             (length != LEN_NONE ? UNSUPPORTED : argClass == ARG_INTEGER && argSize == sizeof(int) ? OK : BAD_TYPE) :
+           conversion == 's' ?
+             (length != LEN_NONE ? UNSUPPORTED : argClass == ARG_STRING ? OK : BAD_TYPE) :
+           conversion == 'p' ?
+             (length != LEN_NONE ? UNSUPPORTED : argClass == ARG_POINTER || argClass == ARG_STRING ? OK : BAD_TYPE) :
+           UNSUPPORTED;
+  }
+};
+
+/* the class and the size after the default argument promotions of an argument type */
+template<typename T> struct CLogArgInfo
+{
+  typedef typename std::decay<T>::type Type;
+  typedef typename std::remove_cv<typename std::remove_pointer<Type>::type>::type Pointee;
+  static constexpr int argClass =
+    std::is_integral<Type>::value || std::is_enum<Type>::value ? CLogFormat::ARG_INTEGER :
+    std::is_same<Type, long double>::value ? CLogFormat::ARG_LONGDOUBLE :
+    std::is_floating_point<Type>::value ? CLogFormat::ARG_DOUBLE :
+    std::is_pointer<Type>::value && (std::is_same<Pointee, char>::value || std::is_same<Pointee, signed char>::value ||
+                                     std::is_same<Pointee, unsigned char>::value) ? CLogFormat::ARG_STRING :
+    std::is_pointer<Type>::value || std::is_same<Type, std::nullptr_t>::value ? CLogFormat::ARG_POINTER :
+    CLogFormat::ARG_OTHER;
+  static constexpr size_t size = argClass == CLogFormat::ARG_INTEGER && sizeof(Type) < sizeof(int) ? sizeof(int) : sizeof(Type);
+};
+
+/* walks the format with the argument types left, see CLogCheckFormat() */
+template<typename... A> struct CLogFormatChecker;
+
+template<> struct CLogFormatChecker<>
+{
+  static constexpr int Check(const char* p) { return *CLogFormat::NextConversion(p) == 0 ? CLogFormat::OK : CLogFormat::TOO_FEW_ARGUMENTS; }
+  static constexpr int Precision(const char*) { return CLogFormat::TOO_FEW_ARGUMENTS; }
+  static constexpr int Value(const char*) { return CLogFormat::TOO_FEW_ARGUMENTS; }
+};
+
+template<typename T, typename... Rest> struct CLogFormatChecker<T, Rest...>
+{
+  typedef CLogArgInfo<T> Info;
+  static constexpr bool IsStar() { return Info::argClass == CLogFormat::ARG_INTEGER && Info::size == sizeof(int); }
+
+  static constexpr int Check(const char* p) { return Conversion(CLogFormat::NextConversion(p)); }
+  /* at the '%' */
+  static constexpr int Conversion(const char* p)
+  {
+    return *p == 0 ? CLogFormat::TOO_MANY_ARGUMENTS : CLogFormat::IsPositional(p + 1) ? CLogFormat::UNSUPPORTED :
+           Width(CLogFormat::SkipFlags(p + 1));
+  }
+  static constexpr int Width(const char* p)
+  {
+    return *p != '*' ? Precision(CLogFormat::SkipDigits(p)) :
+           IsStar() ? CLogFormatChecker<Rest...>::Precision(p + 1) : CLogFormat::BAD_TYPE;
+  }
+  static constexpr int Precision(const char* p)
+  {
+    return *p != '.' ? Value(p) : p[1] != '*' ? Value(CLogFormat::SkipDigits(p + 1)) :
+           IsStar() ? CLogFormatChecker<Rest...>::Value(p + 2) : CLogFormat::BAD_TYPE;
+  }
+  /* at the length modifier */
+  static constexpr int Value(const char* p)
+  {
+    return Next(CLogFormat::Match(Info::argClass, Info::size, CLogFormat::LengthOf(p), p[CLogFormat::LengthChars(p)]),
+                p + CLogFormat::LengthChars(p) + 1);
+  }
+  static constexpr int Next(int result, const char* p) { return result != CLogFormat::OK ? result : CLogFormatChecker<Rest...>::Check(p); }
+};
+
+template<typename... A> struct CLogArgTypes {};
+/* only for decltype, the types of the arguments a clog_*() call passes */
+template<typename... A> CLogArgTypes<A...> CLogGetArgTypes(const A&...);
+
+/*! \brief CLogFormat::OK if the arguments of types A fit format. */
+template<typename... A> constexpr int CLogCheckFormat(const char* format, CLogArgTypes<A...>)
+{
+  return CLogFormatChecker<A...>::Check(format);
+}
+
+/*!
+ \brief A format string taken apart: literal pieces and a slot per argument (or '*' value).
+ The format has to live as long as the program (a literal), the pieces point into it.
+ */
+class CLogFormatProgram : public NonCopyable
+{
+public:
+  explicit CLogFormatProgram(const char* format);
+
+  /*! \brief Append the formatted text to out. The arguments have to fit the format (see CLogCheckFormat()). */
+  template<typename... A> void Format(CStringBuilder& out, const A&... args) const
+  {
+    size_t op = 0;
+    int stars[2];
+    unsigned int starCount = 0;
+    Run(out, op, stars, starCount, args...);
+    AppendLiterals(out, op);
+  }
+
+  /*! \brief Format and log as a record of level, the level has to be logged. */
+  template<typename... A> void Log(CLogger& logger, int level, const A&... args) const
+  {
+    if (!logger.Admit(level))
+      return;
+    CStringBuilder& text = GetThreadBuffer();
+    text.Clear();
+    Format(text, args...);
+    logger.LogString(level, text.Str().data(), text.Size());
+  }
+
+private:
+  enum { OP_LITERAL, OP_STAR, OP_VALUE };
+  struct COp
+  {
+    unsigned char kind;
+    unsigned char length;   // CLogFormat::Length
+    char conversion;
+    bool plain;             // no flags, width or precision
+    const char* text;       // OP_LITERAL: into the format
+    size_t textLength;
+    size_t spec;            // OP_VALUE: offset of the NUL terminated conversion in m_specs
+  };
+
+  void Run(CStringBuilder&, size_t&, int*, unsigned int&) const {}
+  template<typename T, typename... Rest>
+  void Run(CStringBuilder& out, size_t& op, int* stars, unsigned int& starCount, const T& value, const Rest&... rest) const
+  {
+    op = AppendLiterals(out, op);
+    const COp& slot = m_ops[op++];
+    if (slot.kind == OP_STAR)
+      stars[starCount++] = StarValue(value);
+    else
+    {
+      Apply(out, slot, stars, starCount, value, std::integral_constant<int, CLogArgInfo<T>::argClass>());
+      starCount = 0;
+    }
+    Run(out, op, stars, starCount, rest...);
+  }
+
+  template<typename T> static int StarValue(const T& value, typename std::enable_if<std::is_integral<T>::value>::type* = 0) { return (int)value; }
+  template<typename T> static int StarValue(const T&, typename std::enable_if<!std::is_integral<T>::value>::type* = 0) { return 0; }
+
+  template<typename T>
+  void Apply(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const T& value,
+             std::integral_constant<int, CLogFormat::ARG_INTEGER>) const
+  {
+    // sign extended from a signed type, the conversion truncates to its own size
+    typedef typename std::conditional<std::is_enum<T>::value, std::underlying_type<T>, std::common_type<T> >::type::type Integer;
+    ApplyInteger(out, slot, stars, starCount, std::is_signed<Integer>::value ? (uint64_t)(int64_t)(Integer)value : (uint64_t)(Integer)value);
+  }
+  template<typename T>
+  void Apply(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const T& value,
+             std::integral_constant<int, CLogFormat::ARG_DOUBLE>) const
+  {
+    ApplyDouble(out, slot, stars, starCount, (double)value);
+  }
+  void Apply(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, long double value,
+             std::integral_constant<int, CLogFormat::ARG_LONGDOUBLE>) const
+  {
+    ApplyLongDouble(out, slot, stars, starCount, value);
+  }
+  template<typename T>
+  void Apply(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const T& value,
+             std::integral_constant<int, CLogFormat::ARG_STRING>) const
+  {
+    ApplyString(out, slot, stars, starCount, (const char*)value);
+  }
+  template<typename T>
+  void Apply(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const T& value,
+             std::integral_constant<int, CLogFormat::ARG_POINTER>) const
+  {
+    ApplyPointer(out, slot, stars, starCount, (const void*)value);
+  }
+
+  /* appends the literal ops from op on, returns the next argument op */
+  size_t AppendLiterals(CStringBuilder& out, size_t op) const;
+  void ApplyInteger(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, uint64_t value) const;
+  void ApplyDouble(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, double value) const;
+  void ApplyLongDouble(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, long double value) const;
+  void ApplyString(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const char* value) const;
+  void ApplyPointer(CStringBuilder& out, const COp& slot, const int* stars, unsigned int starCount, const void* value) const;
+  static CStringBuilder& GetThreadBuffer();
+
+  std::vector<COp> m_ops;
+  std::string m_specs;
+};
+
+// one static_assert per kind of error, for the message
+#define CLOG_CHECK_FORMAT(format, ...) \
+  static_assert(CLogCheckFormat(format, decltype(CLogGetArgTypes(__VA_ARGS__))()) != CLogFormat::BAD_TYPE, \
+                "log format: an argument doesn't have the type its conversion takes"); \
+  static_assert(CLogCheckFormat(format, decltype(CLogGetArgTypes(__VA_ARGS__))()) != CLogFormat::TOO_FEW_ARGUMENTS, \
+                "log format: fewer arguments than conversions"); \
+  static_assert(CLogCheckFormat(format, decltype(CLogGetArgTypes(__VA_ARGS__))()) != CLogFormat::TOO_MANY_ARGUMENTS, \
+                "log format: more arguments than conversions"); \
+  static_assert(CLogCheckFormat(format, decltype(CLogGetArgTypes(__VA_ARGS__))()) != CLogFormat::UNSUPPORTED, \
+                "log format: a conversion that isn't supported (%n, %ls, %1$d ...)")
+
+#ifdef DISABLE_LOGGING
+#define clogger_log(logger, level, format, ...) do { } while (0)
+#else
+#define clogger_log(logger, level, format, ...) \
+  do \
+  { \
+    CLOG_CHECK_FORMAT(format, ##__VA_ARGS__); \
+    CLogger& clogLogger_ = (logger); \
+    if (clogLogger_.IsLogLevelLogged(level)) \
+    { \
+      static const CLogFormatProgram clogProgram_(format); \
+      clogProgram_.Log(clogLogger_, level, ##__VA_ARGS__); \
+    } \
+  } while (0)
+#endif
+
+// clog_debug() ... log to the default log, clogger_debug(logger, ...) ... to a CLogger
+#define clog_debug(format, ...)   clogger_log(CLog::GetLogger(), LOGDEBUG,   format, ##__VA_ARGS__)
+#define clog_info(format, ...)    clogger_log(CLog::GetLogger(), LOGINFO,    format, ##__VA_ARGS__)
+#define clog_notice(format, ...)  clogger_log(CLog::GetLogger(), LOGNOTICE,  format, ##__VA_ARGS__)
+#define clog_warning(format, ...) clogger_log(CLog::GetLogger(), LOGWARNING, format, ##__VA_ARGS__)
+#define clog_error(format, ...)   clogger_log(CLog::GetLogger(), LOGERROR,   format, ##__VA_ARGS__)
+#define clog_severe(format, ...)  clogger_log(CLog::GetLogger(), LOGSEVERE,  format, ##__VA_ARGS__)
+#define clog_fatal(format, ...)   clogger_log(CLog::GetLogger(), LOGFATAL,   format, ##__VA_ARGS__)
+#define clogger_debug(logger, format, ...)   clogger_log(logger, LOGDEBUG,   format, ##__VA_ARGS__)
+#define clogger_info(logger, format, ...)    clogger_log(logger, LOGINFO,    format, ##__VA_ARGS__)
+#define clogger_notice(logger, format, ...)  clogger_log(logger, LOGNOTICE,  format, ##__VA_ARGS__)
+#define clogger_warning(logger, format, ...) clogger_log(logger, LOGWARNING, format, ##__VA_ARGS__)
+#define clogger_error(logger, format, ...)   clogger_log(logger, LOGERROR,   format, ##__VA_ARGS__)
+#define clogger_severe(logger, format, ...)  clogger_log(logger, LOGSEVERE,  format, ##__VA_ARGS__)
+#define clogger_fatal(logger, format, ...)   clogger_log(logger, LOGFATAL,   format, ##__VA_ARGS__)
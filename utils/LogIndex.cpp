@@ -0,0 +1,127 @@
+#include "LogIndex.h"
+#include <string.h>
+#include <algorithm>
+
+static const char indexMagic[8] = { 'C', 'L', 'O', 'G', 'I', 'D', 'X', 1 };
+static const size_t entrySize = 16;
+
+static void PutUInt64(unsigned char *out, uint64_t value)
+{
+  for (int i = 0; i < 8; i++, value >>= 8)
+    out[i] = (unsigned char)(value & 0xFF);
+}
+
+static uint64_t GetUInt64(const unsigned char *in)
+{
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--)
+    value = (value << 8) | in[i];
+  return value;
+}
+
+/******************************************* CLogIndexWriter *************************************************/
+
+CLogIndexWriter::CLogIndexWriter() :
+  m_file(NULL), m_first(true), m_seconds(0), m_bytes(0), m_lastTime(0), m_lastOffset(0)
+{
+}
+
+CLogIndexWriter::~CLogIndexWriter()
+{
+  Close();
+}
+
+bool CLogIndexWriter::Open(const std::string& indexFilename, unsigned int seconds, uint64_t bytes)
+{
+  Close();
+  m_file = fopen(indexFilename.c_str(), "wb");
+  if (!m_file)
+    return false;
+
+  m_first = true;
+  m_seconds = seconds;
+  m_bytes = bytes;
+  if (fwrite(indexMagic, sizeof(indexMagic), 1, m_file) != 1)
+  {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void CLogIndexWriter::Close()
+{
+  if (m_file)
+  {
+    fclose(m_file);
+    m_file = NULL;
+  }
+}
+
+void CLogIndexWriter::AddEntry(int64_t time, uint64_t offset)
+{
+  // the clock may go back, keep the index sorted
+  if (!m_first && time < m_lastTime)
+    time = m_lastTime;
+
+  unsigned char entry[entrySize];
+  PutUInt64(entry, (uint64_t)time);
+  PutUInt64(entry + 8, offset);
+  (void)fwrite(entry, sizeof(entry), 1, m_file); // buffered, no flush
+
+  m_first = false;
+  m_lastTime = time;
+  m_lastOffset = offset;
+}
+
+/******************************************* CLogIndex *************************************************/
+
+bool CLogIndex::Load(const std::string& indexFilename, uint64_t logSize)
+{
+  m_entries.clear();
+  FILE *file = fopen(indexFilename.c_str(), "rb");
+  if (!file)
+    return false;
+
+  char magic[sizeof(indexMagic)];
+  if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, indexMagic, sizeof(magic)) != 0)
+  {
+    fclose(file);
+    return false;
+  }
+
+  unsigned char buffer[entrySize * 256];
+  size_t count;
+  bool valid = true;
+  while (valid && (count = fread(buffer, entrySize, sizeof(buffer) / entrySize, file)) > 0)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      Entry entry;
+      entry.time = (int64_t)GetUInt64(buffer + i * entrySize);
+      entry.offset = GetUInt64(buffer + i * entrySize + 8);
+      if (entry.offset > logSize ||
+          (!m_entries.empty() && (entry.time < m_entries.back().time || entry.offset < m_entries.back().offset)))
+      {
+        valid = false; // not from this log, or damaged: use what we have so far
+        break;
+      }
+      m_entries.push_back(entry);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+static bool EntryBefore(const CLogIndex::Entry& entry, int64_t time)
+{
+  return entry.time < time;
+}
+
+uint64_t CLogIndex::FindOffset(int64_t time) const
+{
+  std::vector<Entry>::const_iterator it = std::lower_bound(m_entries.begin(), m_entries.end(), time, EntryBefore);
+  if (it == m_entries.begin())
+    return 0;
+  return (it - 1)->offset;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*!
+ \brief Sparse time index of a text log, kept next to it as name.log.idx.
+
+ File: "CLOGIDX" 0x01 (magic and version), then 16 byte entries, each the time
+ (seconds since the epoch, int64 little endian) of a record and the offset of its
+ first byte in the log (uint64 little endian). Entries are only ever appended, in
+ time and offset order.
+
+ The writer buffers the entries with stdio, so indexing costs no system calls
+ of its own apart from one write per few hundred entries. After a crash the index
+ just ends early (possibly in the middle of an entry, which is ignored); the log
+ after its last entry is still found by reading on from there.
+ */
+class CLogIndexWriter
+{
+public:
+  CLogIndexWriter();
+  ~CLogIndexWriter();
+
+  /*! \brief Start a new index file.
+   \param seconds add an entry when at least this many seconds passed since the last one, 0 to not index by time
+   \param bytes add an entry when at least this many bytes were written since the last one, 0 to not index by size
+   */
+  bool Open(const std::string& indexFilename, unsigned int seconds, uint64_t bytes);
+  void Close();
+  bool IsOpen() const { return m_file != NULL; }
+
+  /*! \brief Called before every record is written, with its time and where it starts. */
+  inline void AddRecord(int64_t time, uint64_t offset)
+  {
+    if (m_first || (m_seconds && time - m_lastTime >= m_seconds) || (m_bytes && offset - m_lastOffset >= m_bytes))
+      AddEntry(time, offset);
+  }
+
+private:
+  void AddEntry(int64_t time, uint64_t offset);
+
+  FILE*    m_file;
+  bool     m_first;
+  int64_t  m_seconds;
+  uint64_t m_bytes;
+  int64_t  m_lastTime;
+  uint64_t m_lastOffset;
+};
+
+class CLogIndex
+{
+public:
+  struct Entry
+  {
+    int64_t  time;
+    uint64_t offset;
+  };
+
+  /*! \brief Read an index file. Entries past the end of the log (logSize), out of order or cut short are dropped.
+   \return false if the file can't be read or isn't an index
+   */
+  bool Load(const std::string& indexFilename, uint64_t logSize);
+
+  /*! \brief Where to start reading the log to find the first record at or after time:
+   the offset of the last entry before time (so a record written right at a second
+   boundary is not missed), 0 (the start of the log) if there is none.
+   */
+  uint64_t FindOffset(int64_t time) const;
+
+  const std::vector<Entry>& GetEntries() const { return m_entries; }
+
+private:
+  std::vector<Entry> m_entries;
+};
@@ -0,0 +1,259 @@
+#include "LogRecordPool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+
+// buffer sizes, most records fit the first
+static const size_t classSizes[CLogRecordPool::CLASS_COUNT] = { 256, 1024, 4096, 16384 };
+// buffers per slab, and how many a thread cache takes from or gives to the central list at once
+static const unsigned int slabBuffers[CLogRecordPool::CLASS_COUNT] = { 64, 32, 16, 8 };
+static const unsigned int cacheSize = 16;
+static const unsigned int batchSize = cacheSize / 2;
+
+namespace
+{
+  // a free buffer holds the link to the next one
+  struct CFreeBuffer
+  {
+    CFreeBuffer* next;
+  };
+
+  struct CCentralList
+  {
+    CLogCriticalSection lock;
+    CFreeBuffer* head;
+    CCentralList() : head(NULL) {}
+  };
+
+  struct CPoolCounters
+  {
+    std::atomic<unsigned long long> inUse;
+    std::atomic<unsigned long long> highWater;
+    std::atomic<unsigned long long> slabBytes;
+    std::atomic<unsigned long long> fallbacks;
+    CPoolCounters() : inUse(0), highWater(0), slabBytes(0), fallbacks(0) {}
+  };
+
+  struct CThreadCache
+  {
+    char* buffers[CLogRecordPool::CLASS_COUNT][cacheSize];
+    unsigned int counts[CLogRecordPool::CLASS_COUNT];
+    CThreadCache();
+    ~CThreadCache(); // gives the buffers back when the thread ends
+  };
+}
+
+// never destroyed, threads can end after static destruction began
+static CCentralList* GetCentralLists()
+{
+  static CCentralList* lists = new CCentralList[CLogRecordPool::CLASS_COUNT];
+  return lists;
+}
+
+static CPoolCounters& GetCounters()
+{
+  static CPoolCounters* counters = new CPoolCounters;
+  return *counters;
+}
+
+// under the class lock: take up to count buffers, carving a new slab if the list is empty
+static unsigned int TakeFromCentral(int sizeClass, char** buffers, unsigned int count)
+{
+  CCentralList& list = GetCentralLists()[sizeClass];
+  list.lock.lock();
+  if (!list.head)
+  {
+    const size_t size = classSizes[sizeClass];
+    char* slab = (char*)malloc(size * slabBuffers[sizeClass]);
+    if (slab)
+    {
+      for (unsigned int i = slabBuffers[sizeClass]; i-- > 0;)
+      {
+        CFreeBuffer* buffer = (CFreeBuffer*)(slab + i * size);
+        buffer->next = list.head;
+        list.head = buffer;
+      }
+      GetCounters().slabBytes.fetch_add(size * slabBuffers[sizeClass], std::memory_order_relaxed);
+    }
+  }
+  unsigned int taken = 0;
+  for (; taken < count && list.head; taken++)
+  {
+    buffers[taken] = (char*)list.head;
+    list.head = list.head->next;
+  }
+  list.lock.unlock();
+  return taken;
+}
+
+static void GiveToCentral(int sizeClass, char** buffers, unsigned int count)
+{
+  CCentralList& list = GetCentralLists()[sizeClass];
+  list.lock.lock();
+  for (unsigned int i = 0; i < count; i++)
+  {
+    CFreeBuffer* buffer = (CFreeBuffer*)buffers[i];
+    buffer->next = list.head;
+    list.head = buffer;
+  }
+  list.lock.unlock();
+}
+
+// set when the cache of the thread is destroyed: thread_local and static destructors that run
+// after it can still log, they use the heap (touching t_cache again could construct it anew)
+static thread_local bool t_cacheGone = false;
+
+CThreadCache::CThreadCache()
+{
+  for (int i = 0; i < CLogRecordPool::CLASS_COUNT; i++)
+    counts[i] = 0;
+}
+
+CThreadCache::~CThreadCache()
+{
+  for (int i = 0; i < CLogRecordPool::CLASS_COUNT; i++)
+  {
+    GiveToCentral(i, buffers[i], counts[i]);
+    counts[i] = 0;
+  }
+  t_cacheGone = true;
+}
+
+static thread_local CThreadCache t_cache;
+
+char* CLogRecordPool::Allocate(size_t size, size_t& capacity, int& sizeClass)
+{
+  int c = 0;
+  while (c < CLASS_COUNT && classSizes[c] < size)
+    c++;
+  if (c == CLASS_COUNT)
+    return NULL;
+
+  if (t_cacheGone)
+    return NULL; // the heap fallback
+  CThreadCache& cache = t_cache;
+  unsigned int& count = cache.counts[c];
+  if (count == 0)
+    count = TakeFromCentral(c, cache.buffers[c], batchSize);
+  if (count == 0)
+    return NULL; // out of memory
+
+  CPoolCounters& counters = GetCounters();
+  const unsigned long long inUse = counters.inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+  unsigned long long highWater = counters.highWater.load(std::memory_order_relaxed);
+  while (inUse > highWater && !counters.highWater.compare_exchange_weak(highWater, inUse, std::memory_order_relaxed))
+    ;
+
+  capacity = classSizes[c];
+  sizeClass = c;
+  return cache.buffers[c][--count];
+}
+
+void CLogRecordPool::Release(char* buffer, int sizeClass)
+{
+  GetCounters().inUse.fetch_sub(1, std::memory_order_relaxed);
+  if (t_cacheGone)
+  {
+    GiveToCentral(sizeClass, &buffer, 1);
+    return;
+  }
+  CThreadCache& cache = t_cache;
+  unsigned int& count = cache.counts[sizeClass];
+  if (count == cacheSize)
+  {
+    // keep the most recently used half here
+    GiveToCentral(sizeClass, cache.buffers[sizeClass], batchSize);
+    count -= batchSize;
+    for (unsigned int i = 0; i < count; i++)
+      cache.buffers[sizeClass][i] = cache.buffers[sizeClass][i + batchSize];
+  }
+  cache.buffers[sizeClass][count++] = buffer;
+}
+
+void CLogRecordPool::GetStats(CLogRecordPoolStats& stats)
+{
+  CPoolCounters& counters = GetCounters();
+  stats.inUse = counters.inUse.load(std::memory_order_relaxed);
+  stats.highWater = counters.highWater.load(std::memory_order_relaxed);
+  stats.slabBytes = counters.slabBytes.load(std::memory_order_relaxed);
+  stats.fallbacks = counters.fallbacks.load(std::memory_order_relaxed);
+}
+
+void CLogRecordPool::CountFallback()
+{
+  GetCounters().fallbacks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CLogRecordPool::BeforeFork()
+{
+  CCentralList* lists = GetCentralLists();
+  for (int i = 0; i < CLASS_COUNT; i++)
+    lists[i].lock.lock();
+}
+
+void CLogRecordPool::AfterFork()
+{
+  CCentralList* lists = GetCentralLists();
+  for (int i = CLASS_COUNT; i-- > 0;)
+    lists[i].lock.unlock();
+}
+
+void CLogRecordBuffer::Free()
+{
+  if (m_sizeClass >= 0)
+    CLogRecordPool::Release(m_data, m_sizeClass);
+  else
+    free(m_data);
+  m_data = NULL;
+  m_capacity = 0;
+  m_sizeClass = -1;
+}
+
+bool CLogRecordBuffer::Reserve(size_t size)
+{
+  if (size <= m_capacity)
+    return true;
+  Free();
+  m_data = CLogRecordPool::Allocate(size, m_capacity, m_sizeClass);
+  if (m_data)
+    return true;
+
+  CLogRecordPool::CountFallback();
+  m_data = (char*)malloc(size);
+  m_capacity = m_data ? size : 0;
+  return m_data != NULL;
+}
+
+void CLogRecordBuffer::FormatV(const char* format, va_list args)
+{
+  m_size = 0;
+  if (!format || !format[0] || !Reserve(classSizes[0]))
+    return;
+
+  va_list argCopy;
+  va_copy(argCopy, args);
+  int length = vsnprintf(m_data, m_capacity, format, argCopy);
+  va_end(argCopy);
+#ifdef TARGET_WINDOWS
+  if (length < 0)
+  {
+    // the size needed isn't returned
+    va_copy(argCopy, args);
+    length = _vscprintf(format, argCopy);
+    va_end(argCopy);
+  }
+#endif
+  if (length < 0)
+    return;
+  if ((size_t)length >= m_capacity)
+  {
+    if (!Reserve((size_t)length + 1))
+      return;
+    va_copy(argCopy, args);
+    length = vsnprintf(m_data, m_capacity, format, argCopy);
+    va_end(argCopy);
+    if (length < 0 || (size_t)length >= m_capacity)
+      return;
+  }
+  m_size = (size_t)length;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include "log.h"
+
+/*
+ * Buffers for the records being logged, so that logging a record doesn't go
+ * to the heap once the process has logged for a while.
+ *
+ * Buffers come in a few size classes and are carved from slabs that are never
+ * given back. Each thread keeps a small cache per class and takes or returns
+ * them in batches to a central free list, the buffers themselves link that
+ * list. Only texts longer than the largest class are allocated on the heap
+ * (and counted, see CLogRecordPool::GetStats()).
+ */
+
+struct CLogRecordPoolStats
+{
+  unsigned long long inUse;      // buffers handed out now
+  unsigned long long highWater;  // the most handed out at once
+  unsigned long long slabBytes;  // memory the pool holds, in use or free
+  unsigned long long fallbacks;  // texts too long for a pooled buffer, allocated on the heap
+};
+
+class CLogRecordPool
+{
+public:
+  enum { CLASS_COUNT = 4 };
+  /* a buffer of at least size bytes, sizeClass is what Release() needs back; NULL if too large,
+     or when called from the destructors that run after the thread's cache is gone */
+  static char* Allocate(size_t size, size_t& capacity, int& sizeClass);
+  static void Release(char* buffer, int sizeClass);
+  static void GetStats(CLogRecordPoolStats& stats);
+  /* counts a text that went to the heap instead */
+  static void CountFallback();
+  /* the central list locks over fork(), from CLogger's fork handlers */
+  static void BeforeFork();
+  static void AfterFork();
+};
+
+/*!
+ \brief A formatted message in a pooled buffer, given back when it goes out of scope.
+ */
+class CLogRecordBuffer : public NonCopyable
+{
+public:
+  CLogRecordBuffer() : m_data(NULL), m_capacity(0), m_size(0), m_sizeClass(-1) {}
+  ~CLogRecordBuffer() { Free(); }
+
+  /*! \brief Format like StringUtils::FormatV(), an empty text for an empty format or a format error. */
+  void FormatV(const char* format, va_list args);
+  const char* Data() const { return m_data ? m_data : ""; }
+  size_t Size() const { return m_size; }
+
+private:
+  /* room for size bytes, the text is not kept */
+  bool Reserve(size_t size);
+  void Free();
+
+  char* m_data;
+  size_t m_capacity;
+  size_t m_size;
+  int m_sizeClass;  // -1 for a heap buffer
+};
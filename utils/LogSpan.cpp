@@ -0,0 +1,183 @@
+#include "LogSpan.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+#ifdef WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+std::atomic<int> CLogSpan::s_minLevel(LOGDEBUG);
+
+namespace
+{
+  struct CTraceEvent
+  {
+    const char* name;
+    unsigned int thread;    // log thread index
+    unsigned int depth;
+    long long start;        // nanoseconds since the trace started
+    long long duration;     // nanoseconds
+  };
+
+  struct CTrace
+  {
+    CLogCriticalSection lock;
+    size_t maxEvents;
+    unsigned long long dropped;
+    std::chrono::steady_clock::time_point start;
+    std::vector<CTraceEvent> events;
+    std::vector<std::string> threadNames; // by thread index
+    CTrace() : maxEvents(0), dropped(0) {}
+  };
+}
+
+static std::atomic<bool> s_tracing(false);
+static std::atomic<int> s_logMinLevel(LOGDEBUG); // the lowest level the default log logs
+static thread_local unsigned int t_depth;
+
+// constructed on first use, spans can end in static constructors
+static CTrace& GetTrace()
+{
+  static CTrace trace;
+  return trace;
+}
+
+void CLogSpan::Begin()
+{
+  m_depth = t_depth++;
+  m_start = std::chrono::steady_clock::now();
+}
+
+void CLogSpan::End()
+{
+  const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  t_depth--;
+  const long long duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count();
+  if (duration >= (long long)m_thresholdMicroseconds * 1000 && CLog::IsLogLevelLogged(m_level))
+    CLog::Log(m_level, "%s: %.3f ms, depth %u", m_name, duration / 1e6, m_depth);
+
+  if (!s_tracing.load(std::memory_order_relaxed))
+    return;
+  const CLogThreadInfo& thread = CLogger::GetThreadInfo();
+  CTrace& trace = GetTrace();
+  trace.lock.lock();
+  if (trace.events.size() >= trace.maxEvents)
+    trace.dropped++;
+  else if (s_tracing.load(std::memory_order_relaxed)) // not stopped meanwhile
+  {
+    CTraceEvent event = { m_name, thread.index, m_depth,
+                          std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - trace.start).count(), duration };
+    trace.events.push_back(event);
+    if (thread.index >= trace.threadNames.size())
+      trace.threadNames.resize(thread.index + 1);
+    std::string& name = trace.threadNames[thread.index];
+    if (name.compare(0, std::string::npos, thread.name, thread.nameLength) != 0)
+      name.assign(thread.name, thread.nameLength);
+  }
+  trace.lock.unlock();
+}
+
+void CLogSpan::BeforeFork()
+{
+  GetTrace().lock.lock();
+}
+
+void CLogSpan::AfterFork()
+{
+  GetTrace().lock.unlock();
+}
+
+void CLogSpan::StartTrace(size_t maxEvents /* = 1000000 */)
+{
+  CTrace& trace = GetTrace();
+  trace.lock.lock();
+  trace.maxEvents = maxEvents;
+  trace.dropped = 0;
+  trace.events.clear();
+  trace.events.reserve(maxEvents < 65536 ? maxEvents : 65536);
+  trace.threadNames.clear();
+  trace.start = std::chrono::steady_clock::now();
+  s_tracing.store(true, std::memory_order_relaxed);
+  trace.lock.unlock();
+  UpdateMinLevel();
+}
+
+static void WriteJsonString(FILE* file, const char* str)
+{
+  fputc('"', file);
+  for (const unsigned char* p = (const unsigned char*)str; *p; p++)
+  {
+    if (*p == '"' || *p == '\\')
+      fprintf(file, "\\%c", *p);
+    else if (*p < 0x20)
+      fprintf(file, "\\u%04x", *p);
+    else
+      fputc(*p, file);
+  }
+  fputc('"', file);
+}
+
+bool CLogSpan::StopTrace(const char* path)
+{
+  CTrace& trace = GetTrace();
+  std::vector<CTraceEvent> events;
+  std::vector<std::string> threadNames;
+  trace.lock.lock();
+  const bool wasTracing = s_tracing.exchange(false, std::memory_order_relaxed);
+  events.swap(trace.events);
+  threadNames.swap(trace.threadNames);
+  const unsigned long long dropped = trace.dropped;
+  trace.lock.unlock();
+  UpdateMinLevel();
+  if (!wasTracing)
+    return false;
+
+  FILE* file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  // complete ("X") events, microseconds; metadata events name the threads like the log does
+  const int pid = (int)getpid();
+  fprintf(file, "{\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"clog\"}}", pid);
+  for (size_t i = 1; i < threadNames.size(); i++)
+  {
+    fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", pid, (unsigned int)i);
+    const std::string name = threadNames[i].empty() ? "T:" + std::to_string(i) : "T:" + std::to_string(i) + " " + threadNames[i];
+    WriteJsonString(file, name.c_str());
+    fprintf(file, "}}");
+  }
+  for (size_t i = 0; i < events.size(); i++)
+  {
+    const CTraceEvent& event = events[i];
+    fprintf(file, ",\n{\"name\":");
+    WriteJsonString(file, event.name);
+    fprintf(file, ",\"cat\":\"span\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"depth\":%u}}",
+            event.start / 1e3, event.duration / 1e3, pid, event.thread, event.depth);
+  }
+  fprintf(file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedSpans\":%llu}}\n", dropped);
+  const bool ok = !ferror(file);
+  return fclose(file) == 0 && ok;
+}
+
+void CLogSpan::SetLogLevel(int logLevel)
+{
+#if defined(_DEBUG) || defined(PROFILE)
+  (void)logLevel;
+  s_logMinLevel.store(LOGDEBUG, std::memory_order_relaxed);
+#else
+  // see CLogger::IsLogLevelLogged()
+  s_logMinLevel.store(logLevel >= LOG_LEVEL_DEBUG ? LOGDEBUG : logLevel <= LOG_LEVEL_NONE ? LOGNONE : LOGNOTICE,
+                      std::memory_order_relaxed);
+#endif
+  UpdateMinLevel();
+}
+
+void CLogSpan::UpdateMinLevel()
+{
+  s_minLevel.store(s_tracing.load(std::memory_order_relaxed) ? LOGDEBUG : s_logMinLevel.load(std::memory_order_relaxed),
+                   std::memory_order_relaxed);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include "log.h"
+
+/*!
+ \brief Times a scope and logs one record when it ends, "parse: 1.234 ms, depth 1",
+ the depth being the number of spans the thread was in when it started (0 for the outermost).
+ \code
+ void Parse()
+ {
+   CLogSpan span(LOGDEBUG, "parse");
+   ...
+ }
+ \endcode
+ The record is written to the default log, when level is logged and the span took at least
+ thresholdMicroseconds. Between StartTrace() and StopTrace() every span is also kept for a
+ trace file, whatever its level.
+
+ A span of a level that isn't logged while no trace is running costs one relaxed atomic load
+ and a branch, the clock is not read. It uses the steady (monotonic) clock.
+ */
+class CLogSpan : public NonCopyable
+{
+public:
+  /*!
+   \param name kept by pointer, it has to live until the trace is written (a literal)
+   */
+  inline CLogSpan(int level, const char* name, unsigned int thresholdMicroseconds = 0) :
+    m_name(name), m_level(level), m_thresholdMicroseconds(thresholdMicroseconds), m_depth(0),
+    m_active(level >= s_minLevel.load(std::memory_order_relaxed))
+  {
+    if (m_active)
+      Begin();
+  }
+
+  inline ~CLogSpan()
+  {
+    if (m_active)
+      End();
+  }
+
+  /*! \brief Keep the spans that end from now on, for StopTrace(). The first maxEvents are kept, the rest are counted. */
+  static void StartTrace(size_t maxEvents = 1000000);
+  /*! \brief Stop keeping spans and write the kept ones as a Chrome Trace Event JSON file
+   (chrome://tracing, ui.perfetto.dev), threads are shown by their log index and name.
+   \return false if the file can't be written (or no trace was started)
+   */
+  static bool StopTrace(const char* path);
+  /*! \brief Called by CLog::SetLogLevel(), spans below what it logs are skipped. */
+  static void SetLogLevel(int logLevel);
+
+private:
+  friend class CLogger;
+  void Begin();
+  void End();
+  static void UpdateMinLevel();
+  /* the trace lock over fork(), from CLogger's fork handlers */
+  static void BeforeFork();
+  static void AfterFork();
+
+  const char* m_name;
+  int m_level;
+  unsigned int m_thresholdMicroseconds;
+  unsigned int m_depth;
+  bool m_active;
+  std::chrono::steady_clock::time_point m_start;
+
+  // spans of a lower level do nothing, LOGDEBUG while tracing
+  static std::atomic<int> s_minLevel;
+};
+
+typedef CLogSpan CLogScopedTimer;
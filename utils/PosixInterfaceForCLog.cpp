@@ -1,25 +1,29 @@
 
 #include "PosixInterfaceForCLog.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <chrono>
 
 struct FILEWRAP : public FILE
 {};
 
 
 CPosixInterfaceForCLog::CPosixInterfaceForCLog() :
-  m_file(NULL)
+  m_file(NULL), m_sharedFd(-1), m_size(0), m_flushEveryRecord(true), m_syncPeriodMs(0), m_lastSyncMs(0)
 { }
 
 CPosixInterfaceForCLog::~CPosixInterfaceForCLog()
 {
-  if (m_file)
-    fclose(m_file);
+  CloseLogFile();
 }
 
-bool CPosixInterfaceForCLog::OpenLogFile(const std::string &logFilename, const std::string &backupOldLogToFilename)
+bool CPosixInterfaceForCLog::OpenLogFile(const std::string &logFilename, const std::string &backupOldLogToFilename, bool binary /* = false */)
 {
-  if (m_file)
+  if (m_file || m_sharedFd >= 0)
     return false; // file was already opened
 
   (void)remove(backupOldLogToFilename.c_str()); // if it's failed, try to continue
@@ -28,9 +32,40 @@ bool CPosixInterfaceForCLog::OpenLogFile(const std::string &logFilename, const s
   m_file = (FILEWRAP*)fopen(logFilename.c_str(), "wb");
   if (!m_file)
     return false; // error, can't open log file
+  m_size = 0;
+  if (!m_flushEveryRecord)
+    (void)setvbuf(m_file, NULL, _IOFBF, 64 * 1024); // fewer, larger writes
+
+  if (!binary)
+  {
+    static const unsigned char BOM[3] = { 0xEF, 0xBB, 0xBF };
+    if (fwrite(BOM, sizeof(BOM), 1, m_file) == 1) // write BOM, ignore possible errors
+      m_size += sizeof(BOM);
+  }
+
+  return true;
+}
+
+bool CPosixInterfaceForCLog::OpenSharedLogFile(const std::string &logFilename)
+{
+  if (m_file || m_sharedFd >= 0)
+    return false; // file was already opened
+
+  // only the process that creates the file writes the BOM
+  bool created = true;
+  m_sharedFd = open(logFilename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (m_sharedFd < 0 && errno == EEXIST)
+  {
+    created = false;
+    m_sharedFd = open(logFilename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  }
+  if (m_sharedFd < 0)
+    return false; // error, can't open log file
+  m_size = 0;
 
   static const unsigned char BOM[3] = { 0xEF, 0xBB, 0xBF };
-  (void)fwrite(BOM, sizeof(BOM), 1, m_file); // write BOM, ignore possible errors
+  if (created && write(m_sharedFd, BOM, sizeof(BOM)) == (ssize_t)sizeof(BOM)) // write BOM, ignore possible errors
+    m_size += sizeof(BOM);
 
   return true;
 }
@@ -42,16 +77,87 @@ void CPosixInterfaceForCLog::CloseLogFile()
     fclose(m_file);
     m_file = NULL;
   }
+  if (m_sharedFd >= 0)
+  {
+    close(m_sharedFd);
+    m_sharedFd = -1;
+  }
+}
+
+void CPosixInterfaceForCLog::BeforeFork()
+{
+  if (m_file)
+    (void)fflush(m_file);
 }
 
-bool CPosixInterfaceForCLog::WriteStringToLog(const std::string &logString)
+void CPosixInterfaceForCLog::SetFlushPolicy(bool flushEveryRecord, unsigned int syncPeriodMs)
 {
+  if (flushEveryRecord && !m_flushEveryRecord && m_file)
+    (void)fflush(m_file);
+  m_flushEveryRecord = flushEveryRecord;
+  m_syncPeriodMs = syncPeriodMs;
+}
+
+void CPosixInterfaceForCLog::AfterWrite(bool sync)
+{
+  if (m_syncPeriodMs != 0 || sync)
+  {
+    const long long now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (sync || now - m_lastSyncMs >= m_syncPeriodMs)
+    {
+      if (m_sharedFd >= 0)
+      {
+        (void)fdatasync(m_sharedFd);
+        m_lastSyncMs = now;
+        return;
+      }
+      (void)fflush(m_file);
+      (void)fdatasync(fileno(m_file));
+      m_lastSyncMs = now;
+      return;
+    }
+  }
+  if (m_flushEveryRecord && m_file)
+    (void)fflush(m_file);
+}
+
+bool CPosixInterfaceForCLog::WriteStringToLog(const std::string &logString, bool sync /* = false */)
+{
+  if (m_sharedFd >= 0)
+  {
+    // the record and its line end in one append, other processes' records can't come in between
+    struct iovec parts[2];
+    parts[0].iov_base = (void*)logString.data();
+    parts[0].iov_len = logString.size();
+    parts[1].iov_base = (void*)"\n";
+    parts[1].iov_len = 1;
+    const bool ret = writev(m_sharedFd, parts, 2) == (ssize_t)(logString.size() + 1);
+    AfterWrite(sync);
+    if (ret)
+      m_size += logString.size() + 1;
+    return ret;
+  }
   if (!m_file)
     return false;
 
   const bool ret = (fwrite(logString.data(), logString.size(), 1, m_file) == 1) &&
                    (fwrite("\n", 1, 1, m_file) == 1);
-  (void)fflush(m_file);
+  AfterWrite(sync);
+  if (ret)
+    m_size += logString.size() + 1;
+
+  return ret;
+}
+
+bool CPosixInterfaceForCLog::WriteToLog(const char* data, size_t length, bool sync /* = false */)
+{
+  if (!m_file && m_sharedFd < 0)
+    return false;
+
+  const bool ret = m_sharedFd >= 0 ? write(m_sharedFd, data, length) == (ssize_t)length : fwrite(data, length, 1, m_file) == 1;
+  AfterWrite(sync);
+  if (ret)
+    m_size += length;
 
   return ret;
 }
@@ -59,12 +165,17 @@ bool CPosixInterfaceForCLog::WriteStringToLog(const std::string &logString)
 void CPosixInterfaceForCLog::GetCurrentLocalTime(int& year, int& month, int& day, 
 	int &hour, int &minute, int &second)
 {
-  time_t curTime;
+  ToLocalTime(time(NULL), year, month, day, hour, minute, second);
+}
+
+void CPosixInterfaceForCLog::ToLocalTime(time_t time, int& year, int& month, int& day,
+	int &hour, int &minute, int &second)
+{
   struct tm localTime;
-  if (time(&curTime) != -1 && localtime_r(&curTime, &localTime) != NULL)
+  if (time != -1 && localtime_r(&time, &localTime) != NULL)
   {
-    year   = localTime.tm_year;
-	month  = localTime.tm_mon;
+    year   = localTime.tm_year + 1900;
+    month  = localTime.tm_mon + 1;
 	day    = localTime.tm_mday;
     hour   = localTime.tm_hour;
     minute = localTime.tm_min;
@@ -20,6 +20,7 @@
  */
 
 #include <string>
+#include <time.h>
 
 struct FILEWRAP; // forward declaration, wrapper for FILE
 
@@ -28,11 +29,36 @@ class CPosixInterfaceForCLog
 public:
   CPosixInterfaceForCLog();
   ~CPosixInterfaceForCLog();
-  bool OpenLogFile(const std::string& logFilename, const std::string& backupOldLogToFilename);
+  /* binary files get no BOM */
+  bool OpenLogFile(const std::string& logFilename, const std::string& backupOldLogToFilename, bool binary = false);
+  /* opened for appending (O_APPEND) by several processes, not rotated, with a BOM if it is created;
+     every write is one unbuffered write()/writev() */
+  bool OpenSharedLogFile(const std::string& logFilename);
   void CloseLogFile(void);
-  bool WriteStringToLog(const std::string& logString);
+  /* sync: on disk (fdatasync) before returning, regardless of the flush policy */
+  bool WriteStringToLog(const std::string& logString, bool sync = false);
+  /* write data as it is, no line end or newline conversion */
+  bool WriteToLog(const char* data, size_t length, bool sync = false);
+  /* flushEveryRecord: fflush after every write, else only when the stdio buffer is full
+     syncPeriodMs: if not 0, fflush and fdatasync when writing and this much time passed since the last time */
+  void SetFlushPolicy(bool flushEveryRecord, unsigned int syncPeriodMs);
+  /* fork(): the stdio buffer is written first, so the child doesn't write it again */
+  void BeforeFork();
+  void AfterForkInChild() {}
+  /* bytes written to the log file so far, counted (not asked from the file system) */
+  unsigned long long GetLogSize() const { return m_size; }
   static void GetCurrentLocalTime(int& year, int& month, int& day,
 	  int& hour, int& minute, int& second);
+  /* the local time of a time(), for records that are written later */
+  static void ToLocalTime(time_t time, int& year, int& month, int& day,
+	  int& hour, int& minute, int& second);
 private:
+  void AfterWrite(bool sync);
+
   FILEWRAP* m_file;
+  int m_sharedFd;  // instead of m_file for a shared log, -1 if not open
+  unsigned long long m_size;
+  bool m_flushEveryRecord;
+  unsigned int m_syncPeriodMs;
+  long long m_lastSyncMs;
 };
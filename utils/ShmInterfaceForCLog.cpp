@@ -0,0 +1,227 @@
+
+#include "ShmInterfaceForCLog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static_assert((LOG_SHM_RING_SIZE & (LOG_SHM_RING_SIZE - 1)) == 0, "LOG_SHM_RING_SIZE must be a power of two");
+
+static const char ringMagic[8] = { 'C', 'L', 'O', 'G', 'S', 'H', 'M', 1 };
+static const uint32_t ringHeaderSize = 4096;
+
+static std::string AbsolutePath(const std::string& path)
+{
+  if (!path.empty() && path[0] == '/')
+    return path;
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd)))
+    return path;
+  return std::string(cwd) + "/" + path;
+}
+
+CShmInterfaceForCLog::CShmInterfaceForCLog() :
+  m_header(NULL), m_mappedSize(0), m_head(0), m_size(0), m_syncPeriodMs(0)
+{ }
+
+CShmInterfaceForCLog::~CShmInterfaceForCLog()
+{
+  CloseLogFile();
+}
+
+std::string CShmInterfaceForCLog::GetRingName(const std::string& logFilename)
+{
+  // logs of the same name in different directories get different rings
+  const std::string path(AbsolutePath(logFilename));
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+  for (size_t i = 0; i < path.size(); i++)
+    hash = (hash ^ (unsigned char)path[i]) * 1099511628211ULL;
+  const size_t slash = path.rfind('/');
+  char suffix[24];
+  snprintf(suffix, sizeof(suffix), ".%016llx", (unsigned long long)hash);
+  // within NAME_MAX
+  return "/clog." + path.substr(slash + 1, 200) + suffix;
+}
+
+void CShmInterfaceForCLog::Wait(std::atomic<uint32_t>& word, uint32_t value, unsigned int timeoutMs)
+{
+  struct timespec timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+  syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+void CShmInterfaceForCLog::Wake(std::atomic<uint32_t>& word)
+{
+  syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+bool CShmInterfaceForCLog::IsAlive(int32_t pid)
+{
+  return pid != 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+bool CShmInterfaceForCLog::OpenLogFile(const std::string &logFilename, const std::string &backupOldLogToFilename, bool binary /* = false */)
+{
+  if (m_header)
+    return false; // file was already opened
+
+  const std::string logPath(AbsolutePath(logFilename));
+  const std::string oldLogPath(AbsolutePath(backupOldLogToFilename));
+  if (logPath.size() >= sizeof(m_header->logFile) || oldLogPath.size() >= sizeof(m_header->oldLogFile))
+    return false;
+
+  // a ring left by a crashed process is replaced, an agent still draining it keeps its mapping
+  m_ringName = GetRingName(logFilename);
+  (void)shm_unlink(m_ringName.c_str());
+  const int fd = shm_open(m_ringName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    return false;
+  const size_t size = ringHeaderSize + LOG_SHM_RING_SIZE;
+  void* mapped = ftruncate(fd, size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    (void)shm_unlink(m_ringName.c_str());
+    return false;
+  }
+
+  // zero filled by ftruncate, the agent waits for STATE_OPEN
+  static_assert(sizeof(CShmLogRingHeader) <= ringHeaderSize, "ring header too large");
+  m_header = (CShmLogRingHeader*)mapped;
+  m_mappedSize = size;
+  memcpy(m_header->magic, ringMagic, sizeof(ringMagic));
+  m_header->headerSize = ringHeaderSize;
+  m_header->syncPeriodMs = m_syncPeriodMs;
+  m_header->capacity = LOG_SHM_RING_SIZE;
+  m_header->writerPid = (int32_t)getpid();
+  memcpy(m_header->logFile, logPath.c_str(), logPath.size() + 1);
+  memcpy(m_header->oldLogFile, oldLogPath.c_str(), oldLogPath.size() + 1);
+  m_header->state.store(CShmLogRingHeader::STATE_OPEN, std::memory_order_release);
+  m_head = 0;
+  m_size = 0;
+
+  if (!binary)
+  {
+    static const char BOM[3] = { '\xEF', '\xBB', '\xBF' };
+    (void)Write(BOM, sizeof(BOM), NULL, 0, false); // write BOM, ignore possible errors
+  }
+
+  return true;
+}
+
+void CShmInterfaceForCLog::CloseLogFile()
+{
+  if (!m_header)
+    return;
+
+  m_header->state.store(CShmLogRingHeader::STATE_CLOSED, std::memory_order_seq_cst);
+  if (m_header->agentWaiting.exchange(0, std::memory_order_seq_cst))
+    Wake(m_header->agentWaiting);
+  (void)shm_unlink(m_ringName.c_str());
+  munmap(m_header, m_mappedSize);
+  m_header = NULL;
+}
+
+void CShmInterfaceForCLog::AfterForkInChild()
+{
+  if (!m_header)
+    return;
+
+  // unmap without closing, the ring and its name still belong to the parent
+  munmap(m_header, m_mappedSize);
+  m_header = NULL;
+}
+
+void CShmInterfaceForCLog::SetFlushPolicy(bool /* flushEveryRecord */, unsigned int syncPeriodMs)
+{
+  m_syncPeriodMs = syncPeriodMs;
+  if (m_header)
+    m_header->syncPeriodMs = syncPeriodMs;
+}
+
+bool CShmInterfaceForCLog::WaitForRoom(uint64_t free)
+{
+  const uint64_t capacity = m_header->capacity;
+  for (;;)
+  {
+    if (capacity - (m_head - m_header->tail.load(std::memory_order_acquire)) >= free)
+      return true;
+    if (!IsAlive(m_header->agentPid.load(std::memory_order_relaxed)))
+      return false;
+
+    // the agent wakes us after moving the tail if it sees the flag
+    m_header->writerWaiting.store(1, std::memory_order_seq_cst);
+    if (capacity - (m_head - m_header->tail.load(std::memory_order_seq_cst)) >= free)
+      return true;
+    Wait(m_header->writerWaiting, 1, 10);
+  }
+}
+
+void CShmInterfaceForCLog::CopyToRing(const char* data, size_t length)
+{
+  const uint64_t capacity = m_header->capacity;
+  const uint64_t offset = m_head & (capacity - 1);
+  const size_t first = length < capacity - offset ? length : (size_t)(capacity - offset);
+  char* ring = GetRingData(m_header);
+  memcpy(ring + offset, data, first);
+  memcpy(ring, data + first, length - first);
+  m_head += length;
+}
+
+bool CShmInterfaceForCLog::Commit(const char* data, size_t length, const char* end, size_t endLength, bool sync)
+{
+  if (!WaitForRoom((uint64_t)length + endLength))
+  {
+    m_header->dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  CopyToRing(data, length);
+  CopyToRing(end, endLength);
+  if (sync)
+    m_header->syncRequest.store(m_head, std::memory_order_relaxed);
+  m_header->head.store(m_head, std::memory_order_seq_cst);
+  m_size += length + endLength;
+
+  if (m_header->agentWaiting.load(std::memory_order_seq_cst) && m_header->agentWaiting.exchange(0, std::memory_order_seq_cst))
+    Wake(m_header->agentWaiting);
+  return true;
+}
+
+bool CShmInterfaceForCLog::Write(const char* data, size_t length, const char* end, size_t endLength, bool sync)
+{
+  if (!m_header)
+    return false;
+
+  const uint64_t capacity = m_header->capacity;
+  if ((uint64_t)length + endLength <= capacity)
+    return Commit(data, length, end, endLength, sync);
+
+  // larger than the ring, committed in halves of it as the agent makes room
+  std::string record(data, length);
+  record.append(end, endLength);
+  const size_t chunk = (size_t)(capacity / 2);
+  for (size_t done = 0; done < record.size(); done += chunk)
+  {
+    const size_t count = record.size() - done < chunk ? record.size() - done : chunk;
+    if (!Commit(record.data() + done, count, NULL, 0, sync && done + count == record.size()))
+      return false;
+  }
+  return true;
+}
+
+bool CShmInterfaceForCLog::WriteStringToLog(const std::string &logString, bool sync /* = false */)
+{
+  return Write(logString.data(), logString.size(), "\n", 1, sync);
+}
+
+bool CShmInterfaceForCLog::WriteToLog(const char* data, size_t length, bool sync /* = false */)
+{
+  return Write(data, length, NULL, 0, sync);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <atomic>
+#include "PosixInterfaceForCLog.h"
+
+/*
+ * Log "file" in a POSIX shared memory ring, written to disk by tools/clog-agent
+ * (build with LOG_SHM_RING defined to use it instead of CPosixInterfaceForCLog).
+ *
+ * The ring is named after the log file, "/clog.<file name>.<hash of its absolute path>"
+ * (see GetRingName()), the agent is given the same path.
+ * OpenLogFile() replaces an existing ring of that name and puts the absolute log
+ * and backup paths in the header, the agent rotates and opens the file and writes
+ * everything committed to the ring, byte for byte what CPosixInterfaceForCLog would
+ * have written. Once a record is committed it survives a crash of the process, the
+ * agent drains the ring after the process is gone.
+ *
+ * One writer (the log lock is held around every write) and one reader. The header
+ * has the free running head (bytes committed) and tail (bytes written by the agent),
+ * each side only advances its own, and waits on a futex in the shared memory when
+ * the ring is full or empty. Without an agent attached, records that don't fit are
+ * dropped (and counted) instead of blocking the process.
+ */
+
+#ifndef LOG_SHM_RING_SIZE
+#define LOG_SHM_RING_SIZE (4 * 1024 * 1024) // bytes, a power of two
+#endif
+
+struct CShmLogRingHeader
+{
+  enum { STATE_INITIALIZING = 0, STATE_OPEN = 1, STATE_CLOSED = 2 };
+
+  char magic[8];                           // "CLOGSHM" 0x01, set last by the writer
+  uint32_t headerSize;                     // the data starts here
+  uint32_t syncPeriodMs;                   // the agent fdatasyncs this often while writing, 0 for never
+  uint64_t capacity;                       // data bytes, a power of two
+  int32_t writerPid;
+  char logFile[1024];                      // absolute paths
+  char oldLogFile[1024];
+
+  alignas(64) std::atomic<uint64_t> head;  // writer: bytes committed
+  std::atomic<uint64_t> syncRequest;       // writer: fdatasync once this much is written
+  std::atomic<uint64_t> dropped;           // writer: records dropped without an agent
+  std::atomic<uint32_t> state;
+  std::atomic<uint32_t> agentWaiting;      // futex, 1 while the agent waits for data
+  alignas(64) std::atomic<uint64_t> tail;  // agent: bytes written to the file
+  std::atomic<int32_t> agentPid;           // 0 if none attached
+  std::atomic<uint32_t> writerWaiting;     // futex, 1 while the writer waits for room
+};
+
+class CShmInterfaceForCLog
+{
+public:
+  CShmInterfaceForCLog();
+  ~CShmInterfaceForCLog();
+  /* the files are only opened (and rotated) by the agent; binary files get no BOM */
+  bool OpenLogFile(const std::string& logFilename, const std::string& backupOldLogToFilename, bool binary = false);
+  /* not supported, the ring has a single writer; false */
+  bool OpenSharedLogFile(const std::string& /* logFilename */) { return false; }
+  /* marks the ring closed and removes its name, the agent still writes what is left */
+  void CloseLogFile(void);
+  /* sync: asks the agent to fdatasync once it wrote this record, doesn't wait for it */
+  bool WriteStringToLog(const std::string& logString, bool sync = false);
+  /* write data as it is, no line end or newline conversion */
+  bool WriteToLog(const char* data, size_t length, bool sync = false);
+  /* flushEveryRecord: nothing to do here, the agent writes whatever is committed
+     syncPeriodMs: passed on to the agent */
+  void SetFlushPolicy(bool flushEveryRecord, unsigned int syncPeriodMs);
+  void BeforeFork() {}
+  /* the ring stays the parent's, the child's records are dropped */
+  void AfterForkInChild();
+  /* bytes committed to the ring so far, the size the log file will have */
+  unsigned long long GetLogSize() const { return m_size; }
+  static void GetCurrentLocalTime(int& year, int& month, int& day,
+	  int& hour, int& minute, int& second)
+  { CPosixInterfaceForCLog::GetCurrentLocalTime(year, month, day, hour, minute, second); }
+  static void ToLocalTime(time_t time, int& year, int& month, int& day,
+	  int& hour, int& minute, int& second)
+  { CPosixInterfaceForCLog::ToLocalTime(time, year, month, day, hour, minute, second); }
+
+  /* "/clog.<file name>.<hash>", the shared memory object for a log file; relative
+     paths are taken from the current directory */
+  static std::string GetRingName(const std::string& logFilename);
+  /* the data area of a mapped ring */
+  static char* GetRingData(CShmLogRingHeader* header) { return (char*)header + header->headerSize; }
+  /* futex on a word in the ring header, shared between processes */
+  static void Wait(std::atomic<uint32_t>& word, uint32_t value, unsigned int timeoutMs);
+  static void Wake(std::atomic<uint32_t>& word);
+  /* kill(pid, 0), pid 0 is never alive */
+  static bool IsAlive(int32_t pid);
+
+private:
+  bool Write(const char* data, size_t length, const char* end, size_t endLength, bool sync);
+  // one piece no larger than the ring: wait for room, copy and publish the new head
+  bool Commit(const char* data, size_t length, const char* end, size_t endLength, bool sync);
+  void CopyToRing(const char* data, size_t length);
+  // wait until free bytes are available; false if no agent is there to make room
+  bool WaitForRoom(uint64_t free);
+
+  CShmLogRingHeader* m_header;
+  size_t m_mappedSize;
+  std::string m_ringName;
+  uint64_t m_head;     // == m_header->head, only written here
+  unsigned long long m_size;
+  unsigned int m_syncPeriodMs;
+};
@@ -0,0 +1,151 @@
+#include "StringBuilder.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char twoDigits[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const char hexDigits[] = "0123456789abcdef";
+
+std::string CStringBuilder::Release()
+{
+  std::string result;
+  result.swap(m_buffer);
+  return result;
+}
+
+char* CStringBuilder::AppendUninitialized(size_t count)
+{
+  const size_t size = m_buffer.size();
+  m_buffer.resize(size + count);
+  return &m_buffer[size];
+}
+
+unsigned int CStringBuilder::DecimalLength(uint64_t value)
+{
+  unsigned int length = 1;
+  for (;;)
+  {
+    if (value < 10) return length;
+    if (value < 100) return length + 1;
+    if (value < 1000) return length + 2;
+    if (value < 10000) return length + 3;
+    value /= 10000;
+    length += 4;
+  }
+}
+
+unsigned int CStringBuilder::IntegerLength(int64_t value)
+{
+  if (value < 0)
+    return 1 + DecimalLength(0 - (uint64_t)value);
+  return DecimalLength((uint64_t)value);
+}
+
+CStringBuilder& CStringBuilder::AppendUnsigned(uint64_t value, unsigned int minDigits /* = 0 */)
+{
+  const unsigned int digits = DecimalLength(value);
+  const unsigned int length = digits > minDigits ? digits : minDigits;
+  char *out = AppendUninitialized(length);
+  char *p = out + length;
+  // two digits at a time from the back
+  while (value >= 100)
+  {
+    const unsigned int pair = (unsigned int)(value % 100) * 2;
+    value /= 100;
+    *--p = twoDigits[pair + 1];
+    *--p = twoDigits[pair];
+  }
+  if (value >= 10)
+  {
+    *--p = twoDigits[value * 2 + 1];
+    *--p = twoDigits[value * 2];
+  }
+  else
+    *--p = (char)('0' + value);
+  while (p > out)
+    *--p = '0';
+  return *this;
+}
+
+CStringBuilder& CStringBuilder::AppendInteger(int64_t value)
+{
+  if (value < 0)
+  {
+    m_buffer.push_back('-');
+    return AppendUnsigned(0 - (uint64_t)value);
+  }
+  return AppendUnsigned((uint64_t)value);
+}
+
+CStringBuilder& CStringBuilder::AppendHex(uint64_t value, unsigned int digits)
+{
+  char *out = AppendUninitialized(digits);
+  for (unsigned int i = digits; i > 0; i--)
+  {
+    out[i - 1] = hexDigits[value & 0xF];
+    value >>= 4;
+  }
+  return *this;
+}
+
+CStringBuilder& CStringBuilder::AppendRightAligned(const char *str, size_t width)
+{
+  const size_t length = strlen(str);
+  if (length < width)
+    m_buffer.append(width - length, ' ');
+  m_buffer.append(str, length);
+  return *this;
+}
+
+CStringBuilder& CStringBuilder::PadTo(size_t column, char ch /* = ' ' */)
+{
+  if (m_buffer.size() < column)
+    m_buffer.append(column - m_buffer.size(), ch);
+  return *this;
+}
+
+CStringBuilder& CStringBuilder::AppendFormat(const char *fmt, ...)
+{
+  va_list args;
+  va_start(args, fmt);
+  AppendFormatV(fmt, args);
+  va_end(args);
+  return *this;
+}
+
+CStringBuilder& CStringBuilder::AppendFormatV(const char *fmt, va_list args)
+{
+  // try the space that is already allocated first, measure and retry only if it didn't fit
+  const size_t size = m_buffer.size();
+  size_t room = m_buffer.capacity() - size;
+  if (room < 64)
+    room = 64;
+  m_buffer.resize(size + room);
+
+  va_list argCopy;
+  va_copy(argCopy, args);
+  const int length = vsnprintf(&m_buffer[size], room + 1, fmt, argCopy);
+  va_end(argCopy);
+  if (length < 0)
+  {
+    m_buffer.resize(size);
+    return *this;
+  }
+  if ((size_t)length > room)
+  {
+    m_buffer.resize(size + length);
+    vsnprintf(&m_buffer[size], length + 1, fmt, args);
+  }
+  m_buffer.resize(size + length);
+  return *this;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "utils/params_check_macros.h"
+
+/*!
+ \brief Builds a std::string from pieces without intermediate temporaries.
+
+ Meant for the "count first, then write" pattern: work out the final length
+ (the Length helpers below cover the non-string pieces), Reserve() it once,
+ append, and take the result with Release(), which moves the buffer out.
+ Numbers, hex and padding are written directly, without going through printf.
+ Reserving is optional, appending past the reservation grows the buffer as usual.
+ */
+class CStringBuilder
+{
+public:
+  CStringBuilder() {}
+  explicit CStringBuilder(size_t capacity) { m_buffer.reserve(capacity); }
+
+  void Reserve(size_t capacity) { m_buffer.reserve(capacity); }
+  size_t Size() const { return m_buffer.size(); }
+  bool IsEmpty() const { return m_buffer.empty(); }
+  void Clear() { m_buffer.clear(); }
+  const std::string& Str() const { return m_buffer; }
+
+  /*! \brief Hand out the built string, leaves the builder empty. */
+  std::string Release();
+
+  CStringBuilder& Append(const char *str, size_t length) { m_buffer.append(str, length); return *this; }
+  CStringBuilder& Append(const std::string &str) { m_buffer.append(str); return *this; }
+  CStringBuilder& Append(const char *str) { m_buffer.append(str); return *this; }
+  CStringBuilder& Append(char ch) { m_buffer.push_back(ch); return *this; }
+  CStringBuilder& Append(char ch, size_t count) { m_buffer.append(count, ch); return *this; }
+
+  /*! \brief Append value in decimal, left padded with zeros to at least minDigits digits ("%0*llu"). */
+  CStringBuilder& AppendUnsigned(uint64_t value, unsigned int minDigits = 0);
+  /*! \brief Append value in decimal with a '-' for negative values ("%lld"). */
+  CStringBuilder& AppendInteger(int64_t value);
+  /*! \brief Append the low digits * 4 bits of value as lower case hex, exactly digits characters ("%0*llx"). */
+  CStringBuilder& AppendHex(uint64_t value, unsigned int digits);
+  /*! \brief Append str right aligned in a field of width characters ("%*s"). */
+  CStringBuilder& AppendRightAligned(const char *str, size_t width);
+  /*! \brief Append spaces up to a total size of column, nothing if the builder is already that long. */
+  CStringBuilder& PadTo(size_t column, char ch = ' ');
+  /*! \brief printf straight into the buffer. */
+  CStringBuilder& AppendFormat(PRINTF_FORMAT_STRING const char *fmt, ...) PARAM2_PRINTF_FORMAT;
+  CStringBuilder& AppendFormatV(PRINTF_FORMAT_STRING const char *fmt, va_list args);
+
+  /*! \brief Grow by count characters and return where they go, for kernels that fill them directly. */
+  char* AppendUninitialized(size_t count);
+
+  /*! \brief Number of characters AppendUnsigned(value) writes. */
+  static unsigned int DecimalLength(uint64_t value);
+  /*! \brief Number of characters AppendInteger(value) writes. */
+  static unsigned int IntegerLength(int64_t value);
+
+private:
+  std::string m_buffer;
+};
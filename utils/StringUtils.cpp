@@ -30,6 +30,8 @@
 
 
 #include "StringUtils.h"
+#include "KeywordMatcher.h"
+#include "StringBuilder.h"
 //#include "CharsetConverter.h"
 //#include "Util.h"
 #include <locale>
@@ -44,8 +46,16 @@
 #include <stdio.h>
 #include <memory.h>
 #include <algorithm>
+#include <thread>
 //#include "utils/RegExp.h" // don't move or std functions end up in PCRE namespace
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <strings.h>
+#define strnicmp strncasecmp
+#endif
+
 #define FORMAT_BLOCK_SIZE 512 // # of bytes for initial allocation for printf
 
 using namespace std;
@@ -464,75 +474,276 @@ string StringUtils::Right(const string &str, size_t count)
   return str.substr(str.size() - count);
 }
 
-std::string& StringUtils::Trim(std::string &str)
+/* Byte class scanning for the Trim family.
+ * A set of bytes is kept as a 256 bit map for the scalar tail and, where SIMD is
+ * available, tested 16 bytes at a time:
+ *  - SSSE3: two 16 entry nibble tables, byte b is in the set if
+ *    lo[b & 15] & hi[b >> 4] != 0 (one bit per distinct high nibble in the set,
+ *    so this is exact for sets spanning up to 8 high nibbles)
+ *  - SSE2: one compare per member, for sets of up to 8 bytes
+ * Other sets, and other CPUs, use the bit map only.
+ * Only US-ASCII bytes are whitespace, so a UTF-8 sequence is never cut in two. */
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define BYTESET_SSSE3 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BYTESET_SSE2 1
+#endif
+
+#define BYTESET_MAX_COMPARES 8
+
+static inline unsigned int LowestBit(unsigned int x) // x must not be 0
 {
-  TrimLeft(str);
-  return TrimRight(str);
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, x);
+  return index;
+#else
+  return __builtin_ctz(x);
+#endif
 }
 
-std::string& StringUtils::Trim(std::string &str, const char* const chars)
+static inline unsigned int HighestBit(unsigned int x) // x must not be 0
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse(&index, x);
+  return index;
+#else
+  return 31 - __builtin_clz(x);
+#endif
+}
+
+class CByteSet
+{
+public:
+  explicit CByteSet(const char *chars) : m_simd(false)
+  {
+    memset(m_bits, 0, sizeof(m_bits));
+    for (const unsigned char *c = (const unsigned char *)chars; *c; c++)
+      m_bits[*c >> 6] |= (uint64_t)1 << (*c & 63);
+
+#if defined(BYTESET_SSSE3)
+    unsigned char lo[16] = { 0 }, hi[16] = { 0 };
+    unsigned int nibbles = 0;
+    m_simd = true;
+    for (unsigned int h = 0; h < 16 && m_simd; h++)
+    {
+      for (unsigned int l = 0; l < 16; l++)
+      {
+        if (!Contains((unsigned char)(h << 4 | l)))
+          continue;
+        if (hi[h] == 0)
+        {
+          if (nibbles == 8)
+          {
+            m_simd = false;
+            break;
+          }
+          hi[h] = (unsigned char)(1 << nibbles++);
+        }
+        lo[l] |= hi[h];
+      }
+    }
+    m_lo = _mm_loadu_si128((const __m128i *)lo);
+    m_hi = _mm_loadu_si128((const __m128i *)hi);
+#elif defined(BYTESET_SSE2)
+    m_count = 0;
+    for (unsigned int b = 1; b < 256 && m_count <= BYTESET_MAX_COMPARES; b++)
+    {
+      if (Contains((unsigned char)b) && m_count++ < BYTESET_MAX_COMPARES)
+        m_members[m_count - 1] = _mm_set1_epi8((char)b);
+    }
+    m_simd = m_count > 0 && m_count <= BYTESET_MAX_COMPARES;
+#endif
+  }
+
+  bool Contains(unsigned char c) const
+  {
+    return (m_bits[c >> 6] >> (c & 63)) & 1;
+  }
+
+  // first byte of [first, last) that is not in the set, last if there is none
+  const char* SkipLeft(const char *first, const char *last) const
+  {
+#if defined(BYTESET_SSSE3) || defined(BYTESET_SSE2)
+    if (m_simd)
+    {
+      for (; last - first >= 16; first += 16)
+      {
+        const unsigned int outside = ~Match16(first) & 0xFFFF;
+        if (outside)
+          return first + LowestBit(outside);
+      }
+    }
+#endif
+    while (first < last && Contains(*first))
+      first++;
+    return first;
+  }
+
+  // one past the last byte of [first, last) that is not in the set, first if there is none
+  const char* SkipRight(const char *first, const char *last) const
+  {
+#if defined(BYTESET_SSSE3) || defined(BYTESET_SSE2)
+    if (m_simd)
+    {
+      for (; last - first >= 16; last -= 16)
+      {
+        const unsigned int outside = ~Match16(last - 16) & 0xFFFF;
+        if (outside)
+          return last - 16 + HighestBit(outside) + 1;
+      }
+    }
+#endif
+    while (last > first && Contains(last[-1]))
+      last--;
+    return last;
+  }
+
+private:
+#if defined(BYTESET_SSSE3)
+  // bit i set if p[i] is in the set
+  unsigned int Match16(const char *p) const
+  {
+    const __m128i low4 = _mm_set1_epi8(0x0F);
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+    const __m128i lo = _mm_shuffle_epi8(m_lo, _mm_and_si128(v, low4));
+    const __m128i hi = _mm_shuffle_epi8(m_hi, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+    const __m128i outside = _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128());
+    return ~_mm_movemask_epi8(outside) & 0xFFFF;
+  }
+
+  __m128i m_lo;
+  __m128i m_hi;
+#elif defined(BYTESET_SSE2)
+  unsigned int Match16(const char *p) const
+  {
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i inside = _mm_cmpeq_epi8(v, m_members[0]);
+    for (unsigned int i = 1; i < m_count; i++)
+      inside = _mm_or_si128(inside, _mm_cmpeq_epi8(v, m_members[i]));
+    return _mm_movemask_epi8(inside);
+  }
+
+  __m128i m_members[BYTESET_MAX_COMPARES];
+  unsigned int m_count;
+#endif
+  uint64_t m_bits[4];
+  bool m_simd;
+};
+
+static const CByteSet& WhitespaceSet()
+{
+  static const CByteSet whitespace(" \t\n\v\f\r");
+  return whitespace;
+}
+
+void StringUtils::TrimView(const char *&first, const char *&last)
+{
+  const CByteSet &whitespace = WhitespaceSet();
+  first = whitespace.SkipLeft(first, last);
+  last = whitespace.SkipRight(first, last);
+}
+
+void StringUtils::TrimView(const char *&first, const char *&last, const char* const chars)
+{
+  const CByteSet set(chars);
+  first = set.SkipLeft(first, last);
+  last = set.SkipRight(first, last);
+}
+
+const char* StringUtils::TrimLeftView(const char *first, const char *last)
+{
+  return WhitespaceSet().SkipLeft(first, last);
+}
+
+const char* StringUtils::TrimLeftView(const char *first, const char *last, const char* const chars)
+{
+  return CByteSet(chars).SkipLeft(first, last);
+}
+
+const char* StringUtils::TrimRightView(const char *first, const char *last)
+{
+  return WhitespaceSet().SkipRight(first, last);
+}
+
+const char* StringUtils::TrimRightView(const char *first, const char *last, const char* const chars)
 {
-  TrimLeft(str, chars);
-  return TrimRight(str, chars);
+  return CByteSet(chars).SkipRight(first, last);
 }
 
-// hack to check only first byte of UTF-8 character
-// without this hack "TrimX" functions failed on Win32 and OS X with UTF-8 strings
-static int isspace_c(char c)
+// erase everything outside of [first, last), which points into str, with at most one move
+static std::string& KeepRange(std::string &str, const char *first, const char *last)
 {
-  return (c & 0x80) == 0 && ::isspace(c);
+  const size_t begin = first - str.data();
+  str.erase(last - str.data());
+  str.erase(0, begin);
+  return str;
+}
+
+std::string& StringUtils::Trim(std::string &str)
+{
+  const char *first = str.data(), *last = first + str.size();
+  TrimView(first, last);
+  return KeepRange(str, first, last);
+}
+
+std::string& StringUtils::Trim(std::string &str, const char* const chars)
+{
+  const char *first = str.data(), *last = first + str.size();
+  TrimView(first, last, chars);
+  return KeepRange(str, first, last);
 }
 
 std::string& StringUtils::TrimLeft(std::string &str)
 {
-  str.erase(str.begin(), ::find_if(str.begin(), str.end(), ::not1(::ptr_fun(isspace_c))));
+  str.erase(0, TrimLeftView(str.data(), str.data() + str.size()) - str.data());
   return str;
 }
 
 std::string& StringUtils::TrimLeft(std::string &str, const char* const chars)
 {
-  size_t nidx = str.find_first_not_of(chars);
-  str.erase(0, nidx);
+  str.erase(0, TrimLeftView(str.data(), str.data() + str.size(), chars) - str.data());
   return str;
 }
 
 std::string& StringUtils::TrimRight(std::string &str)
 {
-  str.erase(::find_if(str.rbegin(), str.rend(), ::not1(::ptr_fun(isspace_c))).base(), str.end());
+  str.erase(TrimRightView(str.data(), str.data() + str.size()) - str.data());
   return str;
 }
 
 std::string& StringUtils::TrimRight(std::string &str, const char* const chars)
 {
-  size_t nidx = str.find_last_not_of(chars);
-  str.erase(str.npos == nidx ? 0 : ++nidx);
+  str.erase(TrimRightView(str.data(), str.data() + str.size(), chars) - str.data());
   return str;
 }
 
 std::string& StringUtils::RemoveDuplicatedSpacesAndTabs(std::string& str)
 {
-  std::string::iterator it = str.begin();
+  // compact in place, tabs become spaces and a space following a space is dropped
+  if (str.empty())
+    return str;
+  char *out = &str[0];
+  const char *end = out + str.size();
   bool onSpace = false;
-  while(it != str.end())
+  for (const char *in = out; in < end; in++)
   {
-    if (*it == '\t')
-      *it = ' ';
-
-    if (*it == ' ')
+    const char ch = *in == '\t' ? ' ' : *in;
+    if (ch == ' ')
     {
       if (onSpace)
-      {
-        it = str.erase(it);
         continue;
-      }
-      else
-        onSpace = true;
+      onSpace = true;
     }
     else
       onSpace = false;
-
-    ++it;
+    *out++ = ch;
   }
+  str.resize(out - str.data());
   return str;
 }
 
@@ -680,13 +891,18 @@ bool StringUtils::EndsWithNoCase(const std::string &str1, const char *s2)
 
 std::string StringUtils::Join(const vector<string> &strings, const std::string& delimiter)
 {
-  std::string result;
-  for(vector<string>::const_iterator it = strings.begin(); it != strings.end(); ++it )
-    result += (*it) + delimiter;
-  
-  if (!result.empty())
-    result.erase(result.size() - delimiter.size());
-  return result;
+  if (strings.empty())
+    return std::string();
+
+  size_t length = delimiter.size() * (strings.size() - 1);
+  for (vector<string>::const_iterator it = strings.begin(); it != strings.end(); ++it)
+    length += it->size();
+
+  CStringBuilder result(length);
+  result.Append(strings.front());
+  for (vector<string>::const_iterator it = strings.begin() + 1; it != strings.end(); ++it)
+    result.Append(delimiter).Append(*it);
+  return result.Release();
 }
 
 vector<string> StringUtils::Split(const std::string& input, const std::string& delimiter, unsigned int iMaxStrings /* = 0 */)
@@ -755,36 +971,466 @@ int StringUtils::FindNumber(const std::string& strInput, const std::string &strF
   return numfound;
 }
 
-int StringUtils::DateStringToYYYYMMDD(const std::string &dateString)
+/* Number parsing kernels.
+ * Digit runs are validated and converted eight bytes at a time (SWAR) while
+ * there are eight bytes left, byte by byte after that. Nothing allocates. */
+
+static inline uint64_t LoadEightBytes(const char *p)
+{
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  x = __builtin_bswap64(x);
+#endif
+  return x; // first character in the lowest byte
+}
+
+// sets the top bit of every byte of x that is an ASCII digit, clears everything else
+static inline uint64_t DigitBytes(uint64_t x)
+{
+  const uint64_t low = x & 0x7F7F7F7F7F7F7F7FULL;
+  const uint64_t atLeast0 = low + 0x5050505050505050ULL; // bit 7 set for bytes >= '0'
+  const uint64_t above9 = low + 0x4646464646464646ULL;   // bit 7 set for bytes >= ':'
+  return atLeast0 & ~above9 & ~x & 0x8080808080808080ULL;
+}
+
+static inline unsigned int CountTrailingZeros64(uint64_t x) // x must not be 0
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return index;
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+// value of eight ASCII digits, first one in the lowest byte
+static inline uint32_t ParseEightDigits(uint64_t x)
+{
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+  const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+  x -= 0x3030303030303030ULL;
+  x = (x * 10) + (x >> 8);
+  x = (((x & mask) * mul1) + (((x >> 16) & mask) * mul2)) >> 32;
+  return (uint32_t)x;
+}
+
+static inline StringUtils::ParseResult MakeParseResult(const char *ptr, StringUtils::ParseError ec)
+{
+  StringUtils::ParseResult result = { ptr, ec };
+  return result;
+}
+
+size_t StringUtils::CountDigits(const char *first, const char *last)
+{
+  const char *p = first;
+  while (last - p >= 8)
+  {
+    const uint64_t nonDigits = ~DigitBytes(LoadEightBytes(p)) & 0x8080808080808080ULL;
+    if (nonDigits)
+      return (p - first) + CountTrailingZeros64(nonDigits) / 8;
+    p += 8;
+  }
+  while (p < last && isasciidigit(*p))
+    p++;
+  return p - first;
+}
+
+StringUtils::ParseResult StringUtils::ParseUnsigned(const char *first, const char *last, uint64_t &value)
 {
-  vector<string> days = StringUtils::Split(dateString, '-');
-  if (days.size() == 1)
-    return atoi(days[0].c_str());
-  else if (days.size() == 2)
-    return atoi(days[0].c_str())*100+atoi(days[1].c_str());
-  else if (days.size() == 3)
-    return atoi(days[0].c_str())*10000+atoi(days[1].c_str())*100+atoi(days[2].c_str());
+  const size_t digits = CountDigits(first, last);
+  if (digits == 0)
+    return MakeParseResult(first, PARSE_INVALID);
+
+  const char *p = first;
+  const char *end = first + digits;
+  const char *safeEnd = digits > 19 ? first + 19 : end; // 19 digits always fit
+  uint64_t v = 0;
+  while (safeEnd - p >= 8)
+  {
+    v = v * 100000000 + ParseEightDigits(LoadEightBytes(p));
+    p += 8;
+  }
+  while (p < safeEnd)
+    v = v * 10 + (*p++ - '0');
+  for (; p < end; p++)
+  {
+    const unsigned int digit = *p - '0';
+    if (v > (UINT64_MAX - digit) / 10)
+      return MakeParseResult(end, PARSE_OUT_OF_RANGE);
+    v = v * 10 + digit;
+  }
+
+  value = v;
+  return MakeParseResult(end, PARSE_OK);
+}
+
+StringUtils::ParseResult StringUtils::ParseInteger(const char *first, const char *last, int64_t &value)
+{
+  const bool negative = first < last && *first == '-';
+  uint64_t magnitude;
+  ParseResult result = ParseUnsigned(first + (negative ? 1 : 0), last, magnitude);
+  if (result.ec == PARSE_INVALID)
+    return MakeParseResult(first, PARSE_INVALID);
+  if (result.ec != PARSE_OK)
+    return result;
+
+  if (negative)
+  {
+    if (magnitude > (uint64_t)INT64_MAX + 1)
+      return MakeParseResult(result.ptr, PARSE_OUT_OF_RANGE);
+    value = (int64_t)(0 - magnitude);
+  }
   else
+  {
+    if (magnitude > (uint64_t)INT64_MAX)
+      return MakeParseResult(result.ptr, PARSE_OUT_OF_RANGE);
+    value = (int64_t)magnitude;
+  }
+  return result;
+}
+
+static inline int TwoDigits(uint64_t x, unsigned int pos)
+{
+  return (int)((x >> (8 * pos)) & 0x0F) * 10 + (int)((x >> (8 * (pos + 1))) & 0x0F);
+}
+
+StringUtils::ParseResult StringUtils::ParseTime(const char *first, const char *last, int &hours, int &minutes, int &seconds)
+{
+  if (last - first < 8)
+    return MakeParseResult(first, PARSE_INVALID);
+
+  // "HH:MM:SS": digits in bytes 0, 1, 3, 4, 6, 7 and ':' in bytes 2 and 5
+  const uint64_t x = LoadEightBytes(first);
+  const uint64_t digitMask = 0x8080008080008080ULL;
+  if ((DigitBytes(x) & digitMask) != digitMask || ((x >> 16) & 0xFF) != ':' || ((x >> 40) & 0xFF) != ':')
+    return MakeParseResult(first, PARSE_INVALID);
+
+  const int h = TwoDigits(x, 0), m = TwoDigits(x, 3), s = TwoDigits(x, 6);
+  if (h > 23 || m > 59 || s > 60) // allow a leap second
+    return MakeParseResult(first + 8, PARSE_OUT_OF_RANGE);
+
+  hours = h;
+  minutes = m;
+  seconds = s;
+  return MakeParseResult(first + 8, PARSE_OK);
+}
+
+StringUtils::ParseResult StringUtils::ParseDate(const char *first, const char *last, int &year, int &month, int &day)
+{
+  if (last - first < 10)
+    return MakeParseResult(first, PARSE_INVALID);
+
+  // "YYYY-MM-DD": digits in bytes 0-3, 5, 6, '-' in 4 and 7, then two more digits
+  const uint64_t x = LoadEightBytes(first);
+  const uint64_t digitMask = 0x0080800080808080ULL;
+  if ((DigitBytes(x) & digitMask) != digitMask || ((x >> 32) & 0xFF) != '-' || ((x >> 56) & 0xFF) != '-' ||
+      !isasciidigit(first[8]) || !isasciidigit(first[9]))
+    return MakeParseResult(first, PARSE_INVALID);
+
+  const int y = TwoDigits(x, 0) * 100 + TwoDigits(x, 2);
+  const int m = TwoDigits(x, 5);
+  const int d = (first[8] - '0') * 10 + (first[9] - '0');
+  if (m < 1 || m > 12 || d < 1 || d > 31)
+    return MakeParseResult(first + 10, PARSE_OUT_OF_RANGE);
+
+  year = y;
+  month = m;
+  day = d;
+  return MakeParseResult(first + 10, PARSE_OK);
+}
+
+// atoi() on [first, last): leading whitespace, a sign, then as many digits as there are
+static int AtoiRange(const char *first, const char *last)
+{
+  while (first < last && isspace((unsigned char)*first))
+    first++;
+  bool negative = false;
+  if (first < last && (*first == '-' || *first == '+'))
+    negative = *first++ == '-';
+  uint64_t value = 0;
+  if (StringUtils::ParseUnsigned(first, last, value).ec == StringUtils::PARSE_INVALID)
+    return 0;
+  return negative ? -(int)value : (int)value;
+}
+
+int StringUtils::DateStringToYYYYMMDD(const std::string &dateString)
+{
+  const char *first = dateString.c_str();
+  const char *last = first + dateString.size();
+  int year, month, day;
+  ParseResult result = ParseDate(first, last, year, month, day);
+  if (result.ec == PARSE_OK && result.ptr == last)
+    return year * 10000 + month * 100 + day;
+
+  // anything else: split on '-' and take 1, 2 or 3 numbers
+  if (first == last)
+    return -1;
+  int fields[3];
+  size_t count = 0;
+  for (const char *field = first; ; )
+  {
+    const char *end = (const char *)memchr(field, '-', last - field);
+    if (count == 3)
+      return -1;
+    fields[count++] = AtoiRange(field, end ? end : last);
+    if (!end)
+      break;
+    field = end + 1;
+  }
+  if (count == 1)
+    return fields[0];
+  else if (count == 2)
+    return fields[0] * 100 + fields[1];
+  return fields[0] * 10000 + fields[1] * 100 + fields[2];
+}
+
+int64_t StringUtils::AlphaNumericCompare(const wchar_t *left, const wchar_t *right)
+{
+  const wchar_t *l = left;
+  const wchar_t *r = right;
+  const wchar_t *ld, *rd;
+  wchar_t lc, rc;
+  int64_t lnum, rnum;
+  while (*l != 0 && *r != 0)
+  {
+    // check if we have a numerical value
+    if (*l >= L'0' && *l <= L'9' && *r >= L'0' && *r <= L'9')
+    {
+      ld = l;
+      lnum = 0;
+      while (*ld >= L'0' && *ld <= L'9' && ld < l + 15)
+      { // compare only up to 15 digits
+        lnum *= 10;
+        lnum += *ld++ - L'0';
+      }
+      rd = r;
+      rnum = 0;
+      while (*rd >= L'0' && *rd <= L'9' && rd < r + 15)
+      { // compare only up to 15 digits
+        rnum *= 10;
+        rnum += *rd++ - L'0';
+      }
+      // do we have numbers?
+      if (lnum != rnum)
+      { // yes - and they're different!
+        return lnum - rnum;
+      }
+      l = ld;
+      r = rd;
+      continue;
+    }
+    // do case less comparison
+    lc = *l;
+    if (lc >= L'A' && lc <= L'Z')
+      lc += L'a'-L'A';
+    rc = *r;
+    if (rc >= L'A' && rc <= L'Z')
+      rc += L'a'- L'A';
+
+    // ok, do a normal comparison. Add special case stuff (eg '(' characters)) in here later
+    if (lc != rc)
+      return lc < rc ? -1 : 1;
+    l++; r++;
+  }
+  if (*r)
+  { // r is longer
     return -1;
+  }
+  else if (*l)
+  { // l is longer
+    return 1;
+  }
+  return 0; // files are the same
+}
+
+/* Sort keys for AlphaNumericCompare() ordering.
+ * Every character is folded (A-Z only, like the compare) and written UTF-8
+ * encoded, which keeps code point order under memcmp() and keeps ASCII at one
+ * byte. A run of up to 15 digits is written as '0', then the number of
+ * significant digits and the digits themselves: that makes numbers compare by
+ * value against each other and like a '0' against anything else. Digit
+ * characters are never written as themselves, so there's no ambiguity. */
+static inline void AppendCodePoint(std::string &key, uint32_t ch)
+{
+  if (ch < 0x80)
+    key += (char)ch;
+  else if (ch < 0x800)
+  {
+    key += (char)(0xC0 | (ch >> 6));
+    key += (char)(0x80 | (ch & 0x3F));
+  }
+  else if (ch < 0x10000)
+  {
+    key += (char)(0xE0 | (ch >> 12));
+    key += (char)(0x80 | ((ch >> 6) & 0x3F));
+    key += (char)(0x80 | (ch & 0x3F));
+  }
+  else
+  {
+    key += (char)(0xF0 | ((ch >> 18) & 0x07));
+    key += (char)(0x80 | ((ch >> 12) & 0x3F));
+    key += (char)(0x80 | ((ch >> 6) & 0x3F));
+    key += (char)(0x80 | (ch & 0x3F));
+  }
+}
+
+template<typename CHAR>
+static void AppendAlphaNumericKey(std::string &key, const CHAR *str, bool encode)
+{
+  for (const CHAR *p = str; *p; )
+  {
+    if (*p >= '0' && *p <= '9')
+    {
+      const CHAR *end = p;
+      while (*end >= '0' && *end <= '9' && end < p + 15) // same limit as AlphaNumericCompare()
+        end++;
+      while (p < end && *p == '0') // leading zeros don't change the value
+        p++;
+      key += '0';
+      key += (char)(end - p);
+      for (; p < end; p++)
+        key += (char)*p;
+      continue;
+    }
+    CHAR ch = *p++;
+    if (ch >= 'A' && ch <= 'Z')
+      ch += 'a' - 'A';
+    if (encode)
+      AppendCodePoint(key, (uint32_t)ch);
+    else
+      key += (char)ch;
+  }
+}
+
+std::string StringUtils::AlphaNumericSortKey(const wchar_t *str)
+{
+  std::string key;
+  key.reserve(wcslen(str) + 8);
+  // (UTF-16 surrogates are encoded as if they were code points, keeping code unit order)
+  AppendAlphaNumericKey(key, str, true);
+  return key;
+}
+
+std::string StringUtils::AlphaNumericSortKey(const std::string &str)
+{
+  std::string key;
+  key.reserve(str.size() + 8);
+  // UTF-8 byte order is code point order, so bytes can be used as they are
+  AppendAlphaNumericKey(key, str.c_str(), false);
+  return key;
+}
+
+typedef std::pair<std::string, size_t> KeyedIndex;
+
+static inline bool KeyLess(const KeyedIndex &left, const KeyedIndex &right)
+{
+  return left.first < right.first; // keys alone, no need to look at the index
+}
+
+static inline std::string GetSortKey(const std::string &str) { return StringUtils::AlphaNumericSortKey(str); }
+static inline std::string GetSortKey(const std::wstring &str) { return StringUtils::AlphaNumericSortKey(str.c_str()); }
+
+template<typename STRING>
+static void SortByAlphaNumericKey(std::vector<STRING> &strings, unsigned int threads)
+{
+  const size_t count = strings.size();
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  // not worth starting threads for short lists
+  if (threads < 1 || count < 4096)
+    threads = 1;
+  else if (threads > count / 1024)
+    threads = (unsigned int)(count / 1024);
+
+  std::vector<KeyedIndex> keys(count);
+  std::vector<size_t> bounds(threads + 1);
+  for (unsigned int t = 0; t <= threads; t++)
+    bounds[t] = count * t / threads;
+
+  // compute the keys and sort each slice on its own thread
+  std::vector<std::thread> workers;
+  for (unsigned int t = 0; t < threads; t++)
+  {
+    const size_t first = bounds[t], last = bounds[t + 1];
+    workers.push_back(std::thread([&strings, &keys, first, last]()
+    {
+      for (size_t i = first; i < last; i++)
+      {
+        keys[i].first = GetSortKey(strings[i]);
+        keys[i].second = i;
+      }
+      std::sort(keys.begin() + first, keys.begin() + last, KeyLess);
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++)
+    workers[t].join();
+
+  // merge neighbouring slices pairwise, each round in parallel
+  for (size_t width = 1; width < threads; width *= 2)
+  {
+    workers.clear();
+    for (size_t t = 0; t + width < threads; t += 2 * width)
+    {
+      const size_t first = bounds[t], middle = bounds[t + width], last = bounds[std::min(t + 2 * width, (size_t)threads)];
+      workers.push_back(std::thread([&keys, first, middle, last]()
+      {
+        std::inplace_merge(keys.begin() + first, keys.begin() + middle, keys.begin() + last, KeyLess);
+      }));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+      workers[t].join();
+  }
+
+  std::vector<STRING> sorted;
+  sorted.reserve(count);
+  for (size_t i = 0; i < count; i++)
+    sorted.push_back(std::move(strings[keys[i].second]));
+  strings.swap(sorted);
+}
+
+void StringUtils::SortAlphaNumeric(std::vector<std::string> &strings, unsigned int threads /* = 0 */)
+{
+  SortByAlphaNumericKey(strings, threads);
+}
+
+void StringUtils::SortAlphaNumeric(std::vector<std::wstring> &strings, unsigned int threads /* = 0 */)
+{
+  SortByAlphaNumericKey(strings, threads);
 }
 
 long StringUtils::TimeStringToSeconds(const std::string &timeString)
 {
-  std::string strCopy(timeString);
-  StringUtils::Trim(strCopy);
-  if(StringUtils::EndsWithNoCase(strCopy, " min"))
+  const char *first = timeString.c_str();
+  const char *last = first + timeString.size();
+  TrimView(first, last);
+
+  int hours, minutes, seconds;
+  ParseResult result = ParseTime(first, last, hours, minutes, seconds);
+  if (result.ec == PARSE_OK && result.ptr == last)
+    return hours * 3600 + minutes * 60 + seconds;
+
+  if (last - first >= 4 && strnicmp(last - 4, " min", 4) == 0)
   {
     // this is imdb format of "XXX min"
-    return 60 * atoi(strCopy.c_str());
+    return 60 * AtoiRange(first, last);
   }
   else
   {
-    vector<string> secs = StringUtils::Split(strCopy, ':');
     int timeInSecs = 0;
-    for (unsigned int i = 0; i < 3 && i < secs.size(); i++)
+    if (first == last)
+      return timeInSecs;
+    const char *field = first;
+    for (unsigned int i = 0; i < 3; i++)
     {
+      const char *end = (const char *)memchr(field, ':', last - field);
       timeInSecs *= 60;
-      timeInSecs += atoi(secs[i].c_str());
+      timeInSecs += AtoiRange(field, end ? end : last);
+      if (!end)
+        break;
+      field = end + 1;
     }
     return timeInSecs;
   }
@@ -793,34 +1439,32 @@ long StringUtils::TimeStringToSeconds(const std::string &timeString)
 
 bool StringUtils::IsNaturalNumber(const std::string& str)
 {
-  size_t i = 0, n = 0;
+  const char *p = str.c_str();
+  const char *end = p + str.size();
   // allow whitespace,digits,whitespace
-  while (i < str.size() && isspace((unsigned char) str[i]))
-    i++;
-  while (i < str.size() && isdigit((unsigned char) str[i]))
-  {
-    i++; n++;
-  }
-  while (i < str.size() && isspace((unsigned char) str[i]))
-    i++;
-  return i == str.size() && n > 0;
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+  const size_t n = CountDigits(p, end);
+  p += n;
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+  return p == end && n > 0;
 }
 
 bool StringUtils::IsInteger(const std::string& str)
 {
-  size_t i = 0, n = 0;
+  const char *p = str.c_str();
+  const char *end = p + str.size();
   // allow whitespace,-,digits,whitespace
-  while (i < str.size() && isspace((unsigned char) str[i]))
-    i++;
-  if (i < str.size() && str[i] == '-')
-    i++;
-  while (i < str.size() && isdigit((unsigned char) str[i]))
-  {
-    i++; n++;
-  }
-  while (i < str.size() && isspace((unsigned char) str[i]))
-    i++;
-  return i == str.size() && n > 0;
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+  if (p < end && *p == '-')
+    p++;
+  const size_t n = CountDigits(p, end);
+  p += n;
+  while (p < end && isspace((unsigned char) *p))
+    p++;
+  return p == end && n > 0;
 }
 
 int StringUtils::asciidigitvalue(char chr)
@@ -925,6 +1569,11 @@ size_t StringUtils::FindWords(const char *str, const char *wordLowerCase)
   return std::string::npos;
 }
 
+size_t StringUtils::FindWords(const char *str, const CKeywordMatcher &words)
+{
+  return words.Find(str, strlen(str));
+}
+
 // assumes it is called from after the first open bracket is found
 int StringUtils::FindEndBracket(const std::string &str, char opener, char closer, int startPos)
 {
@@ -962,6 +1611,54 @@ void StringUtils::WordToDigits(std::string &word)
   }
 }
 
+// Length of the longest common subsequence, classic dynamic programming over two rows.
+static size_t LongestCommonSubsequence(const std::string &left, const std::string &right)
+{
+  const std::string &shorter = left.size() < right.size() ? left : right;
+  const std::string &longer = left.size() < right.size() ? right : left;
+  std::vector<size_t> prev(shorter.size() + 1, 0), cur(shorter.size() + 1, 0);
+  for (size_t i = 0; i < longer.size(); i++)
+  {
+    for (size_t j = 0; j < shorter.size(); j++)
+    {
+      if (longer[i] == shorter[j])
+        cur[j + 1] = prev[j] + 1;
+      else
+        cur[j + 1] = max(prev[j + 1], cur[j]);
+    }
+    prev.swap(cur);
+  }
+  return prev[shorter.size()];
+}
+
+double StringUtils::CompareFuzzy(const std::string &left, const std::string &right)
+{
+  // Same result as the fstrcmp() based version: fstrcmp() gives the similarity
+  // 2*LCS/(len1+len2), which was then scaled back by (len1+len2)/2 with 0.25 added.
+  return (double)LongestCommonSubsequence(left, right) + 0.25;
+}
+
+int StringUtils::FindBestMatch(const std::string &str, const vector<string> &strings, double &matchscore)
+{
+  int best = -1;
+  matchscore = 0;
+
+  int i = 0;
+  for (vector<string>::const_iterator it = strings.begin(); it != strings.end(); ++it, i++)
+  {
+    int maxlength = (int)max(str.length(), it->length());
+    if (maxlength == 0)
+      maxlength = 1;
+    double score = StringUtils::CompareFuzzy(str, *it) / maxlength;
+    if (score > matchscore)
+    {
+      matchscore = score;
+      best = i;
+    }
+  }
+  return best;
+}
+
 bool StringUtils::ContainsKeyword(const std::string &str, const vector<string> &keywords)
 {
   for (vector<string>::const_iterator it = keywords.begin(); it != keywords.end(); ++it)
@@ -972,6 +1669,11 @@ bool StringUtils::ContainsKeyword(const std::string &str, const vector<string> &
   return false;
 }
 
+bool StringUtils::ContainsKeyword(const std::string &str, const CKeywordMatcher &keywords)
+{
+  return keywords.Contains(str);
+}
+
 size_t StringUtils::utf8_strlen(const char *s)
 {
   size_t length = 0;
@@ -985,14 +1687,27 @@ size_t StringUtils::utf8_strlen(const char *s)
 
 std::string StringUtils::Paramify(const std::string &param)
 {
-  std::string result = param;
-  // escape backspaces
-  StringUtils::Replace(result, "\\", "\\\\");
-  // escape double quotes
-  StringUtils::Replace(result, "\"", "\\\"");
+  // escape backslashes and double quotes, and add double quotes around the whole string
+  size_t escapes = 0;
+  for (size_t i = 0; i < param.size(); i++)
+  {
+    if (param[i] == '\\' || param[i] == '"')
+      escapes++;
+  }
 
-  // add double quotes around the whole string
-  return "\"" + result + "\"";
+  CStringBuilder result(param.size() + escapes + 2);
+  result.Append('"');
+  size_t start = 0;
+  for (size_t i = 0; i < param.size(); i++)
+  {
+    if (param[i] == '\\' || param[i] == '"')
+    {
+      result.Append(param.data() + start, i - start).Append('\\');
+      start = i;
+    }
+  }
+  result.Append(param.data() + start, param.size() - start).Append('"');
+  return result.Release();
 }
 
 std::vector<std::string> StringUtils::Tokenize(const std::string &input, const std::string &delimiters)
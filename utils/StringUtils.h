@@ -37,6 +37,8 @@
 //#include "XBDateTime.h"
 #include "utils/params_check_macros.h"
 
+class CKeywordMatcher;
+
 #ifndef va_copy
 #define va_copy(dst, src) ((dst) = (src))
 #endif
@@ -79,6 +81,17 @@ public:
   static std::string& TrimLeft(std::string &str, const char* const chars);
   static std::string& TrimRight(std::string &str);
   static std::string& TrimRight(std::string &str, const char* const chars);
+  /*! \brief Trim without copying or modifying: narrow [first, last) to the part Trim() would keep.
+   Whitespace is US-ASCII space, \t, \n, \v, \f and \r, same as for Trim().
+   */
+  static void TrimView(const char *&first, const char *&last);
+  static void TrimView(const char *&first, const char *&last, const char* const chars);
+  /*! \brief \return the new start of [first, last) after trimming on the left */
+  static const char* TrimLeftView(const char *first, const char *last);
+  static const char* TrimLeftView(const char *first, const char *last, const char* const chars);
+  /*! \brief \return the new end of [first, last) after trimming on the right */
+  static const char* TrimRightView(const char *first, const char *last);
+  static const char* TrimRightView(const char *first, const char *last, const char* const chars);
   static std::string& RemoveDuplicatedSpacesAndTabs(std::string& str);
   static int Replace(std::string &str, char oldChar, char newChar);
   static int Replace(std::string &str, const std::string &oldStr, const std::string &newStr);
@@ -108,6 +121,19 @@ public:
   static std::vector<std::string> Split(const std::string& input, const char delimiter, size_t iMaxStrings = 0);
   static int FindNumber(const std::string& strInput, const std::string &strFind);
   static int64_t AlphaNumericCompare(const wchar_t *left, const wchar_t *right);
+  /*! \brief Compute a key that sorts like AlphaNumericCompare() ("file9" before "file10", case folded).
+   Comparing two keys with memcmp() (or std::string's operator<) gives the same order as
+   AlphaNumericCompare() on the original strings, so the parsing is done once per string
+   instead of once per comparison.
+   The std::string version works on bytes, which is code point order for UTF-8.
+   */
+  static std::string AlphaNumericSortKey(const wchar_t *str);
+  static std::string AlphaNumericSortKey(const std::string &str);
+  /*! \brief Sort in AlphaNumericCompare() order by way of AlphaNumericSortKey().
+   \param threads number of threads to use for large lists, 0 for one per CPU core
+   */
+  static void SortAlphaNumeric(std::vector<std::string> &strings, unsigned int threads = 0);
+  static void SortAlphaNumeric(std::vector<std::wstring> &strings, unsigned int threads = 0);
   static long TimeStringToSeconds(const std::string &timeString);
   static void RemoveCRLF(std::string& strLine);
 
@@ -131,6 +157,34 @@ public:
    */
   static bool IsInteger(const std::string& str);
 
+  /*! \brief Outcome of the ParseXXX() functions below, modelled after std::from_chars.
+   On success ptr points past the parsed characters. On PARSE_INVALID ptr is the
+   given first and the output is untouched. On PARSE_OUT_OF_RANGE ptr points past
+   the characters that matched the pattern and the output is untouched.
+   */
+  enum ParseError
+  {
+    PARSE_OK = 0,
+    PARSE_INVALID,
+    PARSE_OUT_OF_RANGE
+  };
+  struct ParseResult
+  {
+    const char *ptr;
+    ParseError ec;
+  };
+
+  /*! \brief Length of the run of ASCII digits at the start of [first, last), checked 8 bytes at a time. */
+  static size_t CountDigits(const char *first, const char *last);
+  /*! \brief Parse [0-9]+ at the start of [first, last). No whitespace, no sign, doesn't allocate. */
+  static ParseResult ParseUnsigned(const char *first, const char *last, uint64_t &value);
+  /*! \brief Parse -?[0-9]+ at the start of [first, last). No whitespace, no '+', doesn't allocate. */
+  static ParseResult ParseInteger(const char *first, const char *last, int64_t &value);
+  /*! \brief Parse a "HH:MM:SS" time (exactly two digits each, as written to the log) at the start of [first, last). */
+  static ParseResult ParseTime(const char *first, const char *last, int &hours, int &minutes, int &seconds);
+  /*! \brief Parse a "YYYY-MM-DD" date (month 1-12, day 1-31) at the start of [first, last). */
+  static ParseResult ParseDate(const char *first, const char *last, int &year, int &month, int &day);
+
   /* The next several isasciiXX and asciiXXvalue functions are locale independent (US-ASCII only),
    * as opposed to standard ::isXX (::isalpha, ::isdigit...) which are locale dependent.
    * Next functions get parameter as char and don't need double cast ((int)(unsigned char) is required for standard functions). */
@@ -159,14 +213,31 @@ public:
   static std::string SizeToString(int64_t size);
   static const std::string Empty;
   static size_t FindWords(const char *str, const char *wordLowerCase);
+  /*! \brief FindWords() for a whole set of words at once, in a single pass over str.
+   \param str the zero-terminated string to search
+   \param words matcher built with CKeywordMatcher::MATCH_WORD_START (and ignoreCase to behave like FindWords)
+   \return position of the first word found or std::string::npos
+   */
+  static size_t FindWords(const char *str, const CKeywordMatcher &words);
   static int FindEndBracket(const std::string &str, char opener, char closer, int startPos = 0);
   static int DateStringToYYYYMMDD(const std::string &dateString);
   static void WordToDigits(std::string &word);
   static std::string CreateUUID();
   static bool ValidateUUID(const std::string &uuid); // NB only validates syntax
+  /*! \brief Similarity of two strings: length of their longest common subsequence + 0.25.
+   \sa FindBestMatch, CFuzzyIndex
+   */
   static double CompareFuzzy(const std::string &left, const std::string &right);
+  /*! \brief Find the string most similar to str, scored by CompareFuzzy() / length of the longer string.
+   Scores every string in the list; use CFuzzyIndex for large lists that are searched repeatedly.
+   \return index of the best match, -1 if nothing matched at all
+   */
   static int FindBestMatch(const std::string &str, const std::vector<std::string> &strings, double &matchscore);
   static bool ContainsKeyword(const std::string &str, const std::vector<std::string> &keywords);
+  /*! \brief Check for a precompiled keyword set, costs a single pass over str whatever the
+   number of keywords. Prefer this over the vector version when checking many strings.
+   */
+  static bool ContainsKeyword(const std::string &str, const CKeywordMatcher &keywords);
 
   /*! \brief Escapes the given string to be able to be used as a parameter.
 
@@ -8,7 +8,7 @@
 #include <Windows.h>
 
 CWin32InterfaceForCLog::CWin32InterfaceForCLog() :
-  m_hFile(INVALID_HANDLE_VALUE)
+  m_hFile(INVALID_HANDLE_VALUE), m_size(0), m_syncPeriodMs(0), m_lastSyncMs(0)
 { }
 
 CWin32InterfaceForCLog::~CWin32InterfaceForCLog()
@@ -17,7 +17,7 @@ CWin32InterfaceForCLog::~CWin32InterfaceForCLog()
     CloseHandle(m_hFile);
 }
 
-bool CWin32InterfaceForCLog::OpenLogFile(const std::string& logFilename, const std::string& backupOldLogToFilename)
+bool CWin32InterfaceForCLog::OpenLogFile(const std::string& logFilename, const std::string& backupOldLogToFilename, bool binary /* = false */)
 {
   if (m_hFile != INVALID_HANDLE_VALUE)
     return false; // file was already opened
@@ -35,11 +35,43 @@ bool CWin32InterfaceForCLog::OpenLogFile(const std::string& logFilename, const s
                                   CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
   if (m_hFile == INVALID_HANDLE_VALUE)
     return false;
+  m_size = 0;
 
-  static const unsigned char BOM[3] = { 0xEF, 0xBB, 0xBF };
-  DWORD written;
-  (void)WriteFile(m_hFile, BOM, sizeof(BOM), &written, NULL); // write BOM, ignore possible errors
-  (void)FlushFileBuffers(m_hFile);
+  if (!binary)
+  {
+    static const unsigned char BOM[3] = { 0xEF, 0xBB, 0xBF };
+    DWORD written;
+    if (WriteFile(m_hFile, BOM, sizeof(BOM), &written, NULL) != 0) // write BOM, ignore possible errors
+      m_size += written;
+    (void)FlushFileBuffers(m_hFile);
+  }
+
+  return true;
+}
+
+bool CWin32InterfaceForCLog::OpenSharedLogFile(const std::string& logFilename)
+{
+  if (m_hFile != INVALID_HANDLE_VALUE)
+    return false; // file was already opened
+
+  if (logFilename.empty())
+    return false;
+
+  // every WriteFile() of an append-only handle goes to the end of the file as a whole
+  m_hFile = CreateFile(logFilename.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                       OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_hFile == INVALID_HANDLE_VALUE)
+    return false;
+  const bool created = GetLastError() != ERROR_ALREADY_EXISTS;
+  m_size = 0;
+
+  if (created)
+  {
+    static const unsigned char BOM[3] = { 0xEF, 0xBB, 0xBF };
+    DWORD written;
+    if (WriteFile(m_hFile, BOM, sizeof(BOM), &written, NULL) != 0) // write BOM, ignore possible errors
+      m_size += written;
+  }
 
   return true;
 }
@@ -53,7 +85,25 @@ void CWin32InterfaceForCLog::CloseLogFile(void)
   }
 }
 
-bool CWin32InterfaceForCLog::WriteStringToLog(const std::string& logString)
+void CWin32InterfaceForCLog::SetFlushPolicy(bool flushEveryRecord, unsigned int syncPeriodMs)
+{
+  m_syncPeriodMs = syncPeriodMs;
+}
+
+void CWin32InterfaceForCLog::AfterWrite(bool sync)
+{
+  if (m_syncPeriodMs != 0 || sync)
+  {
+    const unsigned long long now = GetTickCount64();
+    if (sync || now - m_lastSyncMs >= m_syncPeriodMs)
+    {
+      (void)FlushFileBuffers(m_hFile);
+      m_lastSyncMs = now;
+    }
+  }
+}
+
+bool CWin32InterfaceForCLog::WriteStringToLog(const std::string& logString, bool sync /* = false */)
 {
   if (m_hFile == INVALID_HANDLE_VALUE)
     return false;
@@ -64,7 +114,21 @@ bool CWin32InterfaceForCLog::WriteStringToLog(const std::string& logString)
 
   DWORD written;
   const bool ret = (WriteFile(m_hFile, strData.c_str(), strData.length(), &written, NULL) != 0) && written == strData.length();
+  m_size += ret ? written : 0;
+  AfterWrite(sync);
+
+  return ret;
+}
+
+bool CWin32InterfaceForCLog::WriteToLog(const char* data, size_t length, bool sync /* = false */)
+{
+  if (m_hFile == INVALID_HANDLE_VALUE)
+    return false;
 
+  DWORD written;
+  const bool ret = (WriteFile(m_hFile, data, (DWORD)length, &written, NULL) != 0) && written == length;
+  m_size += ret ? written : 0;
+  AfterWrite(sync);
   return ret;
 }
 
@@ -80,3 +144,20 @@ void CWin32InterfaceForCLog::GetCurrentLocalTime(int& year, int& month, int& day
   minute = time.wMinute;
   second = time.wSecond;
 }
+
+void CWin32InterfaceForCLog::ToLocalTime(time_t time, int& year, int& month, int& day,
+	int& hour, int& minute, int& second)
+{
+  struct tm localTime;
+  if (time != -1 && localtime_s(&localTime, &time) == 0)
+  {
+    year   = localTime.tm_year + 1900;
+    month  = localTime.tm_mon + 1;
+    day    = localTime.tm_mday;
+    hour   = localTime.tm_hour;
+    minute = localTime.tm_min;
+    second = localTime.tm_sec;
+  }
+  else
+    year = month = day = hour = minute = second = 0;
+}
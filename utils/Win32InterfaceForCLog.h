@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <time.h>
 
 typedef void* HANDLE; // forward declaration, to avoid inclusion of whole Windows.h
 
@@ -9,11 +10,33 @@ class CWin32InterfaceForCLog
 public:
   CWin32InterfaceForCLog();
   ~CWin32InterfaceForCLog();
-  bool OpenLogFile(const std::string& logFilename, const std::string& backupOldLogToFilename);
+  /* binary files get no BOM */
+  bool OpenLogFile(const std::string& logFilename, const std::string& backupOldLogToFilename, bool binary = false);
+  /* opened for appending (FILE_APPEND_DATA) by several processes, not rotated, with a BOM if it is created */
+  bool OpenSharedLogFile(const std::string& logFilename);
   void CloseLogFile(void);
-  bool WriteStringToLog(const std::string& logString);
+  /* sync: on disk (FlushFileBuffers) before returning, regardless of the flush policy */
+  bool WriteStringToLog(const std::string& logString, bool sync = false);
+  /* write data as it is, no line end or newline conversion */
+  bool WriteToLog(const char* data, size_t length, bool sync = false);
+  /* flushEveryRecord: nothing to do here, every write already goes to the system
+     syncPeriodMs: if not 0, FlushFileBuffers when writing and this much time passed since the last time */
+  void SetFlushPolicy(bool flushEveryRecord, unsigned int syncPeriodMs);
+  /* there is no fork() */
+  void BeforeFork() {}
+  void AfterForkInChild() {}
+  /* bytes written to the log file so far, counted (not asked from the file system) */
+  unsigned long long GetLogSize() const { return m_size; }
   static void GetCurrentLocalTime(int& year, int& month, int& day,
 	  int& hour, int& minute, int& second);
+  /* the local time of a time(), for records that are written later */
+  static void ToLocalTime(time_t time, int& year, int& month, int& day,
+	  int& hour, int& minute, int& second);
 private:
+  void AfterWrite(bool sync);
+
   HANDLE m_hFile;
+  unsigned long long m_size;
+  unsigned int m_syncPeriodMs;
+  unsigned long long m_lastSyncMs;
 };
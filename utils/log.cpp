@@ -1,5 +1,21 @@
 
 #include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#ifdef WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "utils/LogRecordPool.h"
+#include "utils/LogSpan.h"
+#include "utils/StringBuilder.h"
 #include "utils/StringUtils.h"
 #include "utils/URIUtils.h"
 
@@ -19,7 +35,76 @@ protected:
   inline CLogSingleLock(CLogCriticalSection& cs, bool dicrim) : UniqueLock<CLogCriticalSection>(cs,true) {}
 };
 
-/******************************************* Class CLog *************************************************/
+/******************************************* Class CLogger *************************************************/
+
+// thread indexes are per process, the same in every log
+static std::atomic<unsigned int> s_nextThreadIndex;
+
+// the longest write the system appends at once with other processes' writes to the file
+#ifdef PIPE_BUF
+static const size_t atomicAppendSize = PIPE_BUF;
+#else
+static const size_t atomicAppendSize = 4096;
+#endif
+
+namespace
+{
+  // every CLogger, for the fork handlers
+  struct CLoggers
+  {
+    CLogCriticalSection lock;
+    std::vector<CLogger*> loggers;
+  };
+}
+
+// created on first use and never destroyed, loggers can be destroyed in any order at exit
+static CLoggers& GetLoggers()
+{
+  static CLoggers* loggers = new CLoggers;
+  return *loggers;
+}
+
+/**
+ * The log lock around writing records. With an overload policy set it also
+ * measures what the controller looks at, the number of callers waiting for
+ * the lock and how long it is held, and logs the dropped records summary
+ * after releasing it.
+ */
+class CLogger::CWriteLock : public NonCopyable
+{
+public:
+  CWriteLock(CLogger& logger) : m_logger(logger), m_measure(logger.m_overloadEnabled.load(std::memory_order_relaxed)), m_waiting(0)
+  {
+    if (m_measure)
+      m_logger.m_waiting.fetch_add(1, std::memory_order_relaxed);
+    m_logger.critSec.lock();
+    m_logger.m_admitted++;
+    if (m_measure)
+    {
+      m_waiting = m_logger.m_waiting.fetch_sub(1, std::memory_order_relaxed) - 1;
+      m_start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~CWriteLock()
+  {
+    unsigned long long dropped = 0;
+    if (m_measure)
+    {
+      const long long held = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+      dropped = m_logger.UpdateOverload(m_waiting, held > 0xFFFFFFF ? 0xFFFFFFF : (unsigned int)held);
+    }
+    m_logger.critSec.unlock();
+    if (dropped)
+      m_logger.Log(LOGWARNING, "Messages dropped while the log was overloaded: %llu", dropped);
+  }
+
+private:
+  CLogger& m_logger;
+  bool m_measure;
+  unsigned int m_waiting;
+  std::chrono::steady_clock::time_point m_start;
+};
 
 static const char* const levelNames[] =
 {"DEBUG", "INFO", "NOTICE", "WARNING", "ERROR", "SEVERE", "FATAL", "NONE"};
@@ -28,85 +113,241 @@ static const char* const levelNames[] =
 static const char* const logLevelNames[] =
 { "LOG_LEVEL_NONE" /*-1*/, "LOG_LEVEL_NORMAL" /*0*/, "LOG_LEVEL_DEBUG" /*1*/, "LOG_LEVEL_DEBUG_FREEMEM" /*2*/ };
 
-// s_globals is used as static global with CLog global variables
-XBMC_GLOBAL_REF(CLog, g_logInst);
-#define s_globals XBMC_GLOBAL_USE(CLog).m_globalInstance 
-//xbmcutil::GlobalsSingleton<CLog>::Deleter<std::shared_ptr<CLog> > xbmcutil::GlobalsSingleton<CLog>::instance;
 
+CLogger::CLogger() : m_repeatCount(0), m_repeatLogLevel(-1), m_logLevel(LOG_LEVEL_DEBUG), m_lowestLogged(LOGDEBUG), m_extraLogLevels(0), m_lastThreadIndex(0), m_binary(false), m_shared(false), m_indexSeconds(1), m_indexKilobytes(256),
+  m_syncLevel(LOGFATAL), m_backtraceRecords(0), m_backtraceLevel(LOGERROR), m_overloadEnabled(false), m_shedBelow(0), m_waiting(0), m_probe(0), m_admitted(0), m_shedStage(0), m_relievedWrites(0), m_writeMicroseconds(0), m_droppedReported(0)
+{
+  m_overloadPolicy.maxWaiting = m_overloadPolicy.maxWriteMicroseconds = 0;
+  for (int i = 0; i < LOGNONE; i++)
+    m_dropped[i] = 0;
 
-CLog::CLog()
+#if !defined(WIN32)
+  static const int atfork = pthread_atfork(BeforeFork, AfterForkInParent, AfterForkInChild);
+  (void)atfork;
+#endif
+  CLoggers& loggers = GetLoggers();
+  CLogSingleLock lock(loggers.lock);
+  loggers.loggers.push_back(this);
+}
+
+CLogger::~CLogger()
 {
+  CLoggers& loggers = GetLoggers();
+  CLogSingleLock lock(loggers.lock);
+  loggers.loggers.erase(std::find(loggers.loggers.begin(), loggers.loggers.end(), this));
 }
 
-CLog::~CLog()
+void CLogger::Close()
 {
+  CLogSingleLock waitLock(critSec);
+  m_platform.CloseLogFile();
+  m_index.Close();
+  m_repeatLine.clear();
 }
 
-void CLog::Close()
+void CLogger::Log(int loglevel, const char *format, ...)
 {
-  CLogSingleLock waitLock(s_globals.critSec);
-  s_globals.m_platform.CloseLogFile();
-  s_globals.m_repeatLine.clear();
+  va_list va;
+  va_start(va, format);
+  LogV(loglevel, format, va);
+  va_end(va);
 }
 
-void CLog::Log(int loglevel, const char *format, ...)
+void CLogger::LogV(int loglevel, const char *format, va_list args)
 {
-  if (IsLogLevelLogged(loglevel))
+  if (!IsLogLevelLogged(loglevel))
   {
-    va_list va;
-    va_start(va, format);
-    LogString(loglevel, StringUtils::FormatV(format, va));
-    va_end(va);
+    if (m_backtraceRecords != 0)
+      CaptureBacktrace(loglevel, format, args);
+  }
+  else if (Admit(loglevel))
+  {
+    if (m_binary)
+      LogBinary(loglevel, format, args);
+    else
+    {
+      CLogRecordBuffer message;
+      message.FormatV(format, args);
+      LogString(loglevel, message.Data(), message.Size());
+    }
   }
 }
 
-void CLog::LogFunction(int loglevel, const char* functionName, const char* format, ...)
+void CLogger::LogBinary(int logLevel, const char *format, va_list args)
+{
+  if (!format || !format[0])
+    return; // nothing to log, same as an empty string
+
+  const CLogThreadInfo& thread = GetThreadInfo();
+  {
+    CWriteLock writeLock(*this);
+    if (m_backtraceRecords != 0 && (logLevel & LOGMASK) >= m_backtraceLevel)
+      WriteBacktrace();
+    std::string& record = m_binaryRecord;
+    record.clear();
+    if (m_binaryWriter.AppendMessage(record, logLevel, thread, format, args))
+    {
+      m_platform.WriteToLog(record.data(), record.size(), (logLevel & LOGMASK) >= m_syncLevel);
+      return;
+    }
+  }
+  // arguments that can't be stored raw, store the text
+  CLogRecordBuffer message;
+  message.FormatV(format, args);
+  LogString(logLevel, message.Data(), message.Size());
+}
+
+void CLogger::LogFunction(int loglevel, const char* functionName, const char* format, ...)
+{
+  va_list va;
+  va_start(va, format);
+  LogFunctionV(loglevel, functionName, format, va);
+  va_end(va);
+}
+
+void CLogger::LogFunctionV(int loglevel, const char* functionName, const char* format, va_list args)
 {
-  if (IsLogLevelLogged(loglevel))
+  if (IsLogLevelLogged(loglevel) && Admit(loglevel))
   {
     std::string fNameStr;
     if (functionName && functionName[0])
       fNameStr.assign(functionName).append(": ");
-    va_list va;
-    va_start(va, format);
-    LogString(loglevel, fNameStr + StringUtils::FormatV(format, va));
-    va_end(va);
+    LogString(loglevel, fNameStr + StringUtils::FormatV(format, args));
   }
 }
 
-void CLog::LogString(int logLevel, const std::string& logString)
+void CLogger::LogString(int logLevel, const std::string& logString)
+{
+  LogString(logLevel, logString.data(), logString.size());
+}
+
+void CLogger::LogString(int logLevel, const char* message, size_t messageLength)
 {
-  CLogSingleLock waitLock(s_globals.critSec);
-  std::string strData(logString);
-  StringUtils::TrimRight(strData);
-  if (!strData.empty())
+  // trim without copying, and before taking the lock
+  const char *first = message;
+  const size_t length = StringUtils::TrimRightView(first, first + messageLength) - first;
+
+  CWriteLock writeLock(*this);
+  if (m_backtraceRecords != 0 && (logLevel & LOGMASK) >= m_backtraceLevel)
+    WriteBacktrace();
+  if (length != 0)
+    WriteRecord(logLevel, first, length, NULL);
+}
+
+void CLogger::WriteRecord(int logLevel, const char* message, size_t length, const CLogTime* time)
+{
+  if (m_binary)
   {
-    if (s_globals.m_repeatLogLevel == logLevel && s_globals.m_repeatLine == strData
-        && s_globals.m_lastThreadId == (uint64_t)GetCurrentThreadId())
-    {
-      s_globals.m_repeatCount++;
-      return;
-    }
-    else if (s_globals.m_repeatCount)
-    {
-      std::string strData2 = StringUtils::Format("Previous line repeats %d times.",
-                                                s_globals.m_repeatCount);
-      WriteLogString(s_globals.m_repeatLogLevel, strData2);
-      s_globals.m_repeatCount = 0;
-    }
-    
-    s_globals.m_lastThreadId = (unsigned long long)GetCurrentThreadId();
-    s_globals.m_repeatLine = strData;
-    s_globals.m_repeatLogLevel = logLevel;
+    // repeats are collapsed when decoding
+    std::string& record = m_binaryRecord;
+    record.clear();
+    m_binaryWriter.AppendString(record, logLevel, GetThreadInfo(), message, length, time);
+    m_platform.WriteToLog(record.data(), record.size(), (logLevel & LOGMASK) >= m_syncLevel);
+    return;
+  }
 
-    WriteLogString(logLevel, strData);
+  const CLogThreadInfo& thread = GetThreadInfo();
+  if (m_repeatLogLevel == logLevel && m_repeatLine.compare(0, std::string::npos, message, length) == 0
+      && m_lastThreadIndex == thread.index && m_repeatContext.compare(0, std::string::npos, thread.context ? thread.context : "", thread.contextLength) == 0)
+  {
+    m_repeatCount++;
+    return;
+  }
+  else if (m_repeatCount)
+  {
+    std::string strData2 = StringUtils::Format("Previous line repeats %d times.",
+                                              m_repeatCount);
+    WriteLogString(m_repeatLogLevel, strData2, false);
+    m_repeatCount = 0;
+  }
+
+  m_lastThreadIndex = thread.index;
+  m_repeatLine.assign(message, length);
+  m_repeatContext.assign(thread.context ? thread.context : "", thread.contextLength);
+  m_repeatLogLevel = logLevel;
+
+  WriteLogString(logLevel, m_repeatLine, true, time);
+}
+
+namespace
+{
+  // a Log() call kept by CLogger::SetBacktrace()
+  struct CBacktraceRecord
+  {
+    const CLogger* logger; // NULL if the slot is free
+    int level;
+    time_t time;
+    bool formatted;        // arguments holds the message, for formats that can't be captured
+    std::string format;    // copied, the format may not live until the record is written
+    std::string arguments; // see CBinaryLogWriter::AppendArguments()
+  };
+
+  struct CBacktrace
+  {
+    std::vector<CBacktraceRecord> records; // ring, the oldest at next
+    size_t next;
+    CBinaryLogWriter capture;              // caches how to read the va_list per format
+    CBacktrace() : next(0) {}
+  };
+}
+
+static thread_local CBacktrace t_backtrace;
+
+void CLogger::CaptureBacktrace(int loglevel, const char* format, va_list args)
+{
+  // kept only if the record would have been logged at a more verbose log level
+  if ((loglevel & ~LOGMASK & ~m_extraLogLevels) != 0 || m_logLevel <= LOG_LEVEL_NONE || !format || !format[0])
+    return;
+
+  CBacktrace& backtrace = t_backtrace;
+  if (backtrace.records.size() < m_backtraceRecords)
+  {
+    CBacktraceRecord free = CBacktraceRecord();
+    backtrace.records.insert(backtrace.records.begin() + backtrace.next, m_backtraceRecords - backtrace.records.size(), free);
+  }
+  CBacktraceRecord& record = backtrace.records[backtrace.next];
+  backtrace.next = (backtrace.next + 1) % backtrace.records.size();
+
+  record.logger = this;
+  record.level = loglevel & LOGMASK;
+  record.time = ::time(NULL);
+  record.arguments.clear();
+  record.formatted = !backtrace.capture.AppendArguments(record.arguments, format, args);
+  if (record.formatted)
+    record.arguments = StringUtils::FormatV(format, args);
+  else
+    record.format.assign(format);
+}
+
+// under the lock, on the thread that logs the trigger record
+void CLogger::WriteBacktrace()
+{
+  CBacktrace& backtrace = t_backtrace;
+  const size_t size = backtrace.records.size();
+  std::string text;
+  for (size_t i = 0; i < size; i++)
+  {
+    CBacktraceRecord& record = backtrace.records[(backtrace.next + i) % size];
+    if (record.logger != this)
+      continue;
+    record.logger = NULL;
+    if (!record.formatted && !CBinaryLogReader::FormatArguments(record.format.c_str(), record.arguments, text))
+      continue;
+
+    const std::string& message = record.formatted ? record.arguments : text;
+    const char *first = message.data();
+    const size_t length = StringUtils::TrimRightView(first, first + message.size()) - first;
+    if (length == 0)
+      continue;
+    CLogTime time;
+    PlatformInterfaceForCLog::ToLocalTime(record.time, time.year, time.month, time.day, time.hour, time.minute, time.second);
+    WriteRecord(record.level, first, length, &time);
   }
-  
 }
 
-bool CLog::Init(const char* path, const char* name)
+bool CLogger::Init(const char* path, const char* name, int format /* = LOG_FORMAT_TEXT */)
 {
-  CLogSingleLock waitLock(s_globals.critSec);
+  CLogSingleLock waitLock(critSec);
 
   // the log folder location is initialized in the CAdvancedSettings
   // constructor and changed in CApplication::Create()
@@ -114,110 +355,606 @@ bool CLog::Init(const char* path, const char* name)
   std::string appName(name);
   std::string logPath(path);
   URIUtils::AddSlashAtEnd(logPath);
-  return s_globals.m_platform.OpenLogFile(logPath + appName + ".log", logPath + appName + ".old.log");
+  const bool binary = (format == LOG_FORMAT_BINARY);
+  const bool shared = (format == LOG_FORMAT_SHARED);
+  const char* extension = binary ? ".clog" : ".log";
+  if (shared ? !m_platform.OpenSharedLogFile(logPath + appName + extension)
+             : !m_platform.OpenLogFile(logPath + appName + extension, logPath + appName + ".old" + extension, binary))
+    return false;
+
+  m_binary = binary;
+  m_shared = shared;
+  m_processContext = shared ? StringUtils::Format("pid=%d", (int)getpid()) : std::string();
+  m_index.Close();
+  // the offsets of a shared log aren't known, other processes write to it too
+  if (!binary && !shared && (m_indexSeconds || m_indexKilobytes))
+  {
+    // rotated along with the log, a missing index only makes seeking slower
+    const std::string indexFile(logPath + appName + ".log.idx");
+    const std::string oldIndexFile(logPath + appName + ".old.log.idx");
+    (void)remove(oldIndexFile.c_str());
+    (void)rename(indexFile.c_str(), oldIndexFile.c_str());
+    (void)m_index.Open(indexFile, m_indexSeconds, (uint64_t)m_indexKilobytes * 1024);
+  }
+  if (binary)
+  {
+    std::string& header = m_binaryRecord;
+    header.clear();
+    m_binaryWriter.Begin(header);
+    return m_platform.WriteToLog(header.data(), header.size());
+  }
+  return true;
 }
 
-void CLog::MemDump(const char *pData, int length)
+static const char hexDigits[] = "0123456789abcdef";
+
+/* Render rows of
+ *   "<offset> " + " xx xx xx xx " per group of four bytes + " <ascii>"
+ * separated by '\n', the offset is at least four hex digits and the same width on
+ * every row, the hex column is padded to full width on the last row. */
+static void RenderHexDump(CStringBuilder &out, const unsigned char *data, size_t length, unsigned int width, uint64_t offsetBase)
 {
-  Log(LOGDEBUG, "MEM_DUMP: Dumping from %p", pData);
-  for (int i = 0; i < length; i+=16)
+  if (length == 0)
+    return;
+
+  unsigned int offsetDigits = 4;
+  const uint64_t lastOffset = offsetBase + (length - 1) / width * width;
+  while (offsetDigits < 16 && (lastOffset >> (offsetDigits * 4)) != 0)
+    offsetDigits++;
+  const size_t hexColumn = 3 * width + (width + 3) / 4;
+  const size_t rowPrefix = offsetDigits + 1 + hexColumn + 1;
+  const size_t rows = (length + width - 1) / width;
+
+  char *p = out.AppendUninitialized(rows * (rowPrefix + width + 1) - (rows * width - length) - 1);
+  for (size_t row = 0; row < rows; row++)
   {
-    std::string strLine = StringUtils::Format("MEM_DUMP: %04x ", i);
-    const char *alpha = pData;
-    for (int k=0; k < 4 && i + 4*k < length; k++)
+    const size_t start = row * width;
+    const size_t count = length - start < width ? length - start : width;
+    const unsigned char *bytes = data + start;
+
+    uint64_t offset = offsetBase + start;
+    for (unsigned int i = offsetDigits; i > 0; i--, offset >>= 4)
+      p[i - 1] = hexDigits[offset & 0xF];
+    p += offsetDigits;
+    *p++ = ' ';
+
+    char *hex = p;
+    memset(hex, ' ', hexColumn + 1);
+    for (size_t i = 0; i < count; i++)
     {
-      for (int j=0; j < 4 && i + 4*k + j < length; j++)
-      {
-        std::string strFormat = StringUtils::Format(" %02x", (unsigned char)*pData++);
-        strLine += strFormat;
-      }
-      strLine += " ";
+      char *cell = hex + 3 * i + i / 4 + 1;
+      cell[0] = hexDigits[bytes[i] >> 4];
+      cell[1] = hexDigits[bytes[i] & 0xF];
     }
-    // pad with spaces
-    while (strLine.size() < 13*4 + 16)
-      strLine += " ";
-    for (int j=0; j < 16 && i + j < length; j++)
+    p += hexColumn + 1;
+
+    for (size_t i = 0; i < count; i++)
+      *p++ = (bytes[i] >= 32 && bytes[i] < 127) ? (char)bytes[i] : '.';
+    if (row + 1 < rows)
+      *p++ = '\n';
+  }
+}
+
+void CLogger::MemDump(const char *pData, int length)
+{
+  MemDump(pData, length > 0 ? (size_t)length : 0, 16);
+}
+
+void CLogger::MemDump(const char *pData, size_t length, unsigned int width, uint64_t offsetBase /* = 0 */, size_t maxBytes /* = 0 */)
+{
+  if (!IsLogLevelLogged(LOGDEBUG) || !Admit(LOGDEBUG))
+    return;
+
+  if (width == 0)
+    width = 16;
+  const size_t shown = (maxBytes != 0 && length > maxBytes) ? maxBytes : length;
+
+  CStringBuilder record;
+  record.AppendFormat("MEM_DUMP: Dumping %llu bytes from %p", (unsigned long long)length, pData);
+  if (shown != 0)
+    record.Append('\n');
+  RenderHexDump(record, (const unsigned char *)pData, shown, width, offsetBase);
+  if (shown < length)
+    record.AppendFormat("\n... truncated, %llu more bytes not shown", (unsigned long long)(length - shown));
+
+  LogString(LOGDEBUG, record.Str());
+}
+
+// the lowest record level a log level writes, for the inline IsLogLevelLogged()
+static int GetLowestLogged(int logLevel)
+{
+#if defined(_DEBUG) || defined(PROFILE)
+  (void)logLevel;
+  return LOGDEBUG;
+#else
+  if (logLevel >= LOG_LEVEL_DEBUG)
+    return LOGDEBUG;
+  if (logLevel <= LOG_LEVEL_NONE)
+    return LOGMASK + 1;
+
+  // "logLevel" is "LOG_LEVEL_NORMAL"
+  return LOGNOTICE;
+#endif
+}
+
+void CLogger::SetLogLevel(int level)
+{
+  if (level < LOG_LEVEL_NONE || level > LOG_LEVEL_MAX)
+  {
+    Log(LOGERROR, "%s: Invalid log level requested: %d", __FUNCTION__, level);
+    return;
+  }
+
+  {
+    CLogSingleLock waitLock(critSec);
+    m_logLevel = level;
+    m_lowestLogged = GetLowestLogged(level);
+  }
+  // the lock isn't recursive, log the change after leaving it
+  Log(LOGNOTICE, "Log level changed to \"%s\"", logLevelNames[level + 1]);
+}
+
+int CLogger::GetLogLevel() const
+{
+  return m_logLevel;
+}
+
+void CLogger::SetLogIndex(unsigned int seconds, unsigned int kilobytes)
+{
+  CLogSingleLock waitLock(critSec);
+  m_indexSeconds = seconds;
+  m_indexKilobytes = kilobytes;
+}
+
+void CLogger::SetDurability(int mode, unsigned int periodMs /* = 1000 */, int syncLevel /* = LOGFATAL */)
+{
+  CLogSingleLock waitLock(critSec);
+  m_platform.SetFlushPolicy(mode == LOG_DURABILITY_FLUSH, mode == LOG_DURABILITY_PERIODIC ? periodMs : 0);
+  m_syncLevel = syncLevel;
+}
+
+void CLogger::SetBacktrace(unsigned int records, int triggerLevel /* = LOGERROR */)
+{
+  CLogSingleLock waitLock(critSec);
+  m_backtraceRecords = records;
+  m_backtraceLevel = triggerLevel;
+}
+
+void CLogger::SetOverloadPolicy(const CLogOverloadPolicy& policy)
+{
+  CLogSingleLock waitLock(critSec);
+  m_overloadPolicy = policy;
+  m_overloadEnabled.store(policy.maxWaiting != 0 || policy.maxWriteMicroseconds != 0, std::memory_order_relaxed);
+  m_shedStage = 0;
+  m_shedBelow.store(0, std::memory_order_relaxed);
+}
+
+void CLogger::GetOverloadStats(CLogOverloadStats& stats)
+{
+  CLogSingleLock waitLock(critSec);
+  stats.admitted = m_admitted;
+  for (int i = 0; i < LOGNONE; i++)
+    stats.dropped[i] = m_dropped[i].load(std::memory_order_relaxed);
+  stats.shedBelow = m_shedBelow.load(std::memory_order_relaxed);
+  stats.writeMicroseconds = m_writeMicroseconds;
+}
+
+bool CLogger::Admit(int loglevel)
+{
+  const int level = loglevel & LOGMASK;
+  if (level >= m_shedBelow.load(std::memory_order_relaxed))
+    return true;
+  if (m_probe.fetch_add(1, std::memory_order_relaxed) % 1024 == 1023)
+    return true;
+  m_dropped[level].fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+// under the lock, after writing a record: pick what to drop, return the number to report once it's over
+unsigned long long CLogger::UpdateOverload(unsigned int waiting, unsigned int writeMicroseconds)
+{
+  static const int shedBelow[] = { 0, LOGNOTICE, LOGWARNING };
+  static const unsigned int relievedWritesToRecover = 64;
+  const CLogOverloadPolicy& policy = m_overloadPolicy;
+  unsigned int& average = m_writeMicroseconds;
+  average = (average * 3 + writeMicroseconds) / 4;
+
+  int pressure = 0;
+  bool relieved = true;
+  if (policy.maxWaiting)
+  {
+    pressure = std::max(pressure, waiting >= 2 * policy.maxWaiting ? 2 : waiting >= policy.maxWaiting ? 1 : 0);
+    relieved = relieved && waiting < (policy.maxWaiting + 1) / 2;
+  }
+  if (policy.maxWriteMicroseconds)
+  {
+    pressure = std::max(pressure, average >= 2 * policy.maxWriteMicroseconds ? 2 : average >= policy.maxWriteMicroseconds ? 1 : 0);
+    relieved = relieved && average < (policy.maxWriteMicroseconds + 1) / 2;
+  }
+
+  // stop dropping only when the pressure has been low for a while, not at the first quiet moment
+  int& stage = m_shedStage;
+  unsigned int& relievedWrites = m_relievedWrites;
+  relievedWrites = relieved ? relievedWrites + 1 : 0;
+  if (pressure > stage)
+    stage = pressure;
+  else if (pressure < stage && (stage > 1 || relievedWrites >= relievedWritesToRecover))
+    stage--;
+  m_shedBelow.store(shedBelow[stage], std::memory_order_relaxed);
+  if (stage != 0)
+    return 0;
+
+  unsigned long long dropped = 0;
+  for (int i = 0; i < LOGNONE; i++)
+    dropped += m_dropped[i].load(std::memory_order_relaxed);
+  const unsigned long long report = dropped - m_droppedReported;
+  m_droppedReported = dropped;
+  return report;
+}
+
+void CLogger::SetExtraLogLevels(int level)
+{
+  CLogSingleLock waitLock(critSec);
+  m_extraLogLevels = level;
+  
+}
+
+bool CLogger::WriteLogString(int logLevel, const std::string& logString, bool withContext, const CLogTime* time /* = NULL */)
+{
+  CLogTime now;
+  if (!time)
+  {
+    m_platform.GetCurrentLocalTime(now.year, now.month, now.day, now.hour, now.minute, now.second);
+    time = &now;
+  }
+  const CLogThreadInfo& thread = GetThreadInfo();
+  if (m_index.IsOpen())
+    m_index.AddRecord(::time(NULL), m_platform.GetLogSize());
+
+  const char* context = thread.context;
+  size_t contextLength = withContext ? thread.contextLength : 0;
+  if (m_shared)
+  {
+    // every record tells which process wrote it, thread indexes are per process
+    m_sharedContext.assign(m_processContext);
+    if (contextLength)
+      m_sharedContext.append(1, ' ').append(context, contextLength);
+    context = m_sharedContext.data();
+    contextLength = m_sharedContext.size();
+  }
+
+  CStringBuilder& record = m_record;
+  record.Clear();
+  CLog::FormatRecord(record, *time, thread.index, thread.name, thread.nameLength, logLevel,
+                     context, contextLength, logString.data(), logString.size());
+  if (m_shared && record.Size() + 1 > atomicAppendSize)
+    return WriteSharedPieces(logLevel, *time, thread, context, contextLength, logString.data(), logString.size());
+  return m_platform.WriteStringToLog(record.Str(), (logLevel & LOGMASK) >= m_syncLevel);
+}
+
+bool CLogger::WriteSharedPieces(int logLevel, const CLogTime& time, const CLogThreadInfo& thread, const char* context, size_t contextLength,
+                                const char* message, size_t length)
+{
+  static const char continued[] = "(continued) ";
+  // FormatRecord() turns every '\n' into this many bytes
+  static const size_t newlineLength = 45;
+
+  CStringBuilder record;
+  CLog::FormatRecord(record, time, thread.index, thread.name, thread.nameLength, logLevel, context, contextLength, "", 0);
+  const size_t prefixLength = record.Size() + sizeof(continued) - 1 + 1; // and the line end
+  if (prefixLength + 64 > atomicAppendSize)
+  {
+    // no room for text next to the prefix, write it whole
+    record.Clear();
+    CLog::FormatRecord(record, time, thread.index, thread.name, thread.nameLength, logLevel, context, contextLength, message, length);
+    return m_platform.WriteStringToLog(record.Str(), (logLevel & LOGMASK) >= m_syncLevel);
+  }
+  const size_t budget = atomicAppendSize - prefixLength;
+
+  // split at the last line end that fits, else in the line at a character boundary
+  const char* end = message + length;
+  std::string piece;
+  bool ret = true;
+  for (const char* start = message; start < end;)
+  {
+    const char* p = start;
+    const char* lastNewline = NULL;
+    for (size_t size = 0; p < end; p++)
+    {
+      size += *p == '\n' ? newlineLength : 1;
+      if (size > budget)
+        break;
+      if (*p == '\n')
+        lastNewline = p;
+    }
+    const char* cut = p;
+    if (p < end)
     {
-      if (*alpha > 31)
-        strLine += *alpha;
+      if (lastNewline)
+        cut = lastNewline;
       else
-        strLine += '.';
-      alpha++;
+      {
+        while (cut > start + 1 && ((unsigned char)*cut & 0xC0) == 0x80)
+          cut--;
+      }
     }
-    Log(LOGDEBUG, "%s", strLine.c_str());
+
+    piece.assign(start == message ? "" : continued).append(start, cut);
+    record.Clear();
+    CLog::FormatRecord(record, time, thread.index, thread.name, thread.nameLength, logLevel, context, contextLength,
+                       piece.data(), piece.size());
+    start = cut < end && *cut == '\n' ? cut + 1 : cut;
+    ret = m_platform.WriteStringToLog(record.Str(), start >= end && (logLevel & LOGMASK) >= m_syncLevel) && ret;
   }
+  return ret;
 }
 
-void CLog::SetLogLevel(int level)
+// zero-initialized, index 0 means the thread hasn't logged yet
+static thread_local CLogThreadInfo t_threadInfo;
+
+const CLogThreadInfo& CLogger::GetThreadInfo()
 {
-  CLogSingleLock waitLock(s_globals.critSec);
-  if (level >= LOG_LEVEL_NONE && level <= LOG_LEVEL_MAX)
+  CLogThreadInfo& info = t_threadInfo;
+  if (info.index == 0)
   {
-    s_globals.m_logLevel = level;
-    CLog::Log(LOGNOTICE, "Log level changed to \"%s\"", logLevelNames[s_globals.m_logLevel + 1]);
+    info.index = ++s_nextThreadIndex;
+#if defined(__gnu_linux__) || defined(__ANDROID__)
+    info.tid = (unsigned long long)syscall(SYS_gettid);
+#elif defined(_WIN32)
+    info.tid = ::GetCurrentThreadId();
+#endif
   }
-  else
-    CLog::Log(LOGERROR, "%s: Invalid log level requested: %d", __FUNCTION__, level);
-  
+  return info;
+}
+
+void CLogger::BeforeFork()
+{
+  CLoggers& loggers = GetLoggers();
+  loggers.lock.lock();
+  for (size_t i = 0; i < loggers.loggers.size(); i++)
+  {
+    CLogger& logger = *loggers.loggers[i];
+    logger.critSec.lock();
+    logger.m_platform.BeforeFork();
+  }
+  // the record pool is used under the log locks, so its locks come after them
+  CLogRecordPool::BeforeFork();
+  CLogSpan::BeforeFork();
+}
+
+void CLogger::AfterForkInParent()
+{
+  CLogSpan::AfterFork();
+  CLogRecordPool::AfterFork();
+  CLoggers& loggers = GetLoggers();
+  for (size_t i = 0; i < loggers.loggers.size(); i++)
+    loggers.loggers[i]->critSec.unlock();
+  loggers.lock.unlock();
+}
+
+void CLogger::AfterForkInChild()
+{
+  // the child has only the forking thread, which holds every lock; what the parent
+  // still has to write (a pending repeat count, kept backtrace records) stays its own
+  CLogThreadInfo& info = t_threadInfo;
+  if (info.index != 0)
+  {
+#if defined(__gnu_linux__) || defined(__ANDROID__)
+    info.tid = (unsigned long long)syscall(SYS_gettid);
+#endif
+  }
+  std::vector<CBacktraceRecord>& records = t_backtrace.records;
+  for (size_t i = 0; i < records.size(); i++)
+    records[i].logger = NULL;
+  CLogSpan::AfterFork();
+  CLogRecordPool::AfterFork();
+
+  CLoggers& loggers = GetLoggers();
+  for (size_t i = 0; i < loggers.loggers.size(); i++)
+  {
+    CLogger& logger = *loggers.loggers[i];
+    logger.m_repeatCount = 0;
+    logger.m_repeatLine.clear();
+    logger.m_platform.AfterForkInChild();
+    if (logger.m_shared)
+      logger.m_processContext = StringUtils::Format("pid=%d", (int)getpid());
+    logger.critSec.unlock();
+  }
+  loggers.lock.unlock();
+}
+
+/******************************************* Class CLog *************************************************/
+
+// s_globals is the default log behind the static CLog functions,
+// log.h holds the reference that keeps it alive (XBMC_GLOBAL_REF)
+#define s_globals XBMC_GLOBAL_USE(CLog).m_globalInstance
+
+CLog::CLog()
+{
+}
+
+CLog::~CLog()
+{
+}
+
+bool CLog::Init(const char* path, const char* name, int format /* = LOG_FORMAT_TEXT */)
+{
+  return s_globals.Init(path, name, format);
+}
+
+void CLog::Close()
+{
+  s_globals.Close();
+}
+
+void CLog::Log(int loglevel, const char *format, ...)
+{
+  va_list va;
+  va_start(va, format);
+  s_globals.LogV(loglevel, format, va);
+  va_end(va);
+}
+
+void CLog::LogFunction(int loglevel, const char* functionName, const char* format, ...)
+{
+  va_list va;
+  va_start(va, format);
+  s_globals.LogFunctionV(loglevel, functionName, format, va);
+  va_end(va);
+}
+
+void CLog::MemDump(const char *pData, int length)
+{
+  s_globals.MemDump(pData, length);
+}
+
+void CLog::MemDump(const char *pData, size_t length, unsigned int width, uint64_t offsetBase /* = 0 */, size_t maxBytes /* = 0 */)
+{
+  s_globals.MemDump(pData, length, width, offsetBase, maxBytes);
+}
+
+void CLog::SetLogLevel(int level)
+{
+  s_globals.SetLogLevel(level);
+  CLogSpan::SetLogLevel(s_globals.GetLogLevel());
 }
 
 int CLog::GetLogLevel()
 {
-  return s_globals.m_logLevel;
+  return s_globals.GetLogLevel();
 }
 
 void CLog::SetExtraLogLevels(int level)
 {
-  CLogSingleLock waitLock(s_globals.critSec);
-  s_globals.m_extraLogLevels = level;
-  
+  s_globals.SetExtraLogLevels(level);
 }
 
 bool CLog::IsLogLevelLogged(int loglevel)
 {
-  const int extras = (loglevel & ~LOGMASK);
-  if (extras != 0 && (s_globals.m_extraLogLevels & extras) == 0)
-    return false;
+  return s_globals.IsLogLevelLogged(loglevel);
+}
 
-#if defined(_DEBUG) || defined(PROFILE)
-  return true;
-#else
-  if (s_globals.m_logLevel >= LOG_LEVEL_DEBUG)
-    return true;
-  if (s_globals.m_logLevel <= LOG_LEVEL_NONE)
-    return false;
+void CLog::SetLogIndex(unsigned int seconds, unsigned int kilobytes)
+{
+  s_globals.SetLogIndex(seconds, kilobytes);
+}
 
-  // "m_logLevel" is "LOG_LEVEL_NORMAL"
-  return (loglevel & LOGMASK) >= LOGNOTICE;
-#endif
+void CLog::SetOverloadPolicy(const CLogOverloadPolicy& policy)
+{
+  s_globals.SetOverloadPolicy(policy);
 }
 
-bool CLog::WriteLogString(int logLevel, const std::string& logString)
+void CLog::SetDurability(int mode, unsigned int periodMs /* = 1000 */, int syncLevel /* = LOGFATAL */)
 {
-  //static const char* prefixFormat = "%02.2d:%02.2d:%02.2d T:%" PRIu64" %7s: ";
-  static const char* prefixFormat = "%04d-%02d-%02d %02.2d:%02.2d:%02.2d T:%llu %7s: ";
+  s_globals.SetDurability(mode, periodMs, syncLevel);
+}
 
-  std::string strData(logString);
-  /* fixup newline alignment, number of spaces should equal prefix length */
-  StringUtils::Replace(strData, "\n", "\n                                            ");
+void CLog::GetOverloadStats(CLogOverloadStats& stats)
+{
+  s_globals.GetOverloadStats(stats);
+}
 
-  int year, mon, day, hour, minute, second;
-  s_globals.m_platform.GetCurrentLocalTime(year, mon, day, hour, minute, second);
-  
-  strData = StringUtils::Format(prefixFormat, year, mon, day, hour, minute, second,
-                                  (unsigned long long)GetCurrentThreadId(),
-                                  levelNames[logLevel]) + strData;
+void CLog::SetBacktrace(unsigned int records, int triggerLevel /* = LOGERROR */)
+{
+  s_globals.SetBacktrace(records, triggerLevel);
+}
 
-  return s_globals.m_platform.WriteStringToLog(strData);
+void CLog::FormatRecord(CStringBuilder& record, const CLogTime& time, unsigned int threadIndex, const char* threadName, size_t threadNameLength,
+                        int logLevel, const char* context, size_t contextLength, const char* message, size_t length)
+{
+  // "YYYY-MM-DD HH:MM:SS T:<thread index>[ <thread name>] <level right aligned in 7>: [[<context>] ]"
+  static const size_t fixedPrefixLength = 19 + 3 + 1 + 7 + 2;
+  /* lines after a newline in the message are indented by a fixed 44 columns, whatever the
+     prefix length; clog-grep and clog-seek tell continuation lines by it */
+  static const char continuation[] = "\n                                            ";
+
+  const char *end = message + length;
+  const size_t newlines = std::count(message, end, '\n');
+  const unsigned int yearDigits = CStringBuilder::DecimalLength(time.year);
+  record.Reserve(record.Size() + fixedPrefixLength + (yearDigits > 4 ? yearDigits - 4 : 0) + CStringBuilder::DecimalLength(threadIndex) +
+                 (threadNameLength ? threadNameLength + 1 : 0) + (contextLength ? contextLength + 3 : 0) + length + newlines * (sizeof(continuation) - 2));
+
+  record.AppendUnsigned(time.year, 4).Append('-').AppendUnsigned(time.month, 2).Append('-').AppendUnsigned(time.day, 2).Append(' ');
+  record.AppendUnsigned(time.hour, 2).Append(':').AppendUnsigned(time.minute, 2).Append(':').AppendUnsigned(time.second, 2);
+  record.Append(" T:").AppendUnsigned(threadIndex);
+  if (threadNameLength)
+    record.Append(' ').Append(threadName, threadNameLength);
+  record.Append(' ').AppendRightAligned(levelNames[logLevel & LOGMASK], 7).Append(": ", 2);
+  if (contextLength)
+    record.Append('[').Append(context, contextLength).Append("] ", 2);
+
+  const char *start = message;
+  for (const char *nl; (nl = (const char *)memchr(start, '\n', end - start)) != NULL; start = nl + 1)
+    record.Append(start, nl - start).Append(continuation, sizeof(continuation) - 1);
+  record.Append(start, end - start);
 }
 
-ThreadIdentifier CLog::GetCurrentThreadId()
+void CLog::SetThreadName(const char* name)
 {
-#if defined(__gnu_linux__)
-    return pthread_self();
-#elif defined(_WIN32)
-    return ::GetCurrentThreadId();
-#endif
+  CLogger::GetThreadInfo(); // assigns the index
+  CLogThreadInfo& info = t_threadInfo;
+  size_t length = name ? strlen(name) : 0;
+  if (length > sizeof(info.name) - 1)
+    length = sizeof(info.name) - 1;
+  if (length)
+    memcpy(info.name, name, length);
+  info.name[length] = 0;
+  info.nameLength = (unsigned int)length;
+  info.nameVersion++;
+
+  if (length)
+    s_globals.Log(LOGINFO, "Thread T:%u is \"%s\", tid %llu", info.index, info.name, info.tid);
+}
+
+/******************************************* Class CLogContext *************************************************/
+
+// the calling thread's contexts, t_threadInfo.context points to it
+static thread_local std::string t_context;
+
+static void UpdateThreadContext()
+{
+  CLogThreadInfo& info = t_threadInfo;
+  info.context = t_context.data();
+  info.contextLength = (unsigned int)t_context.size();
+  info.contextVersion++;
+}
+
+CLogContext::CLogContext(const char* key, const char* value)
+{
+  Push(key, value ? value : "(null)", value ? strlen(value) : 6);
+}
+
+CLogContext::CLogContext(const char* key, const std::string& value)
+{
+  Push(key, value.data(), value.size());
+}
+
+CLogContext::~CLogContext()
+{
+  t_context.resize(m_previousLength);
+  UpdateThreadContext();
+}
+
+void CLogContext::Push(const char* key, long long value)
+{
+  char digits[24];
+  Push(key, digits, snprintf(digits, sizeof(digits), "%lld", value));
+}
+
+void CLogContext::Push(const char* key, unsigned long long value)
+{
+  char digits[24];
+  Push(key, digits, snprintf(digits, sizeof(digits), "%llu", value));
+}
+
+void CLogContext::Push(const char* key, const char* value, size_t length)
+{
+  std::string& context = t_context;
+  m_previousLength = context.size();
+  if (!context.empty())
+    context.push_back(' ');
+  context.append(key).append(1, '=').append(value, length);
+  UpdateThreadContext();
 }
 
 #ifdef WIN32
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 #ifdef WIN32
 #include <Windows.h>
@@ -10,6 +15,13 @@
 #include <pthread.h>
 #endif
 
+#include <atomic>
+#if defined(__gnu_linux__) || defined(__ANDROID__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #define LOG_LEVEL_NONE         -1 // nothing at all is logged
 #define LOG_LEVEL_NORMAL        0 // shows notice, error, severe and fatal
 #define LOG_LEVEL_DEBUG         1 // shows all
@@ -30,84 +42,124 @@
 #define LOGMASKBIT  5
 #define LOGMASK     ((1 << LOGMASKBIT) - 1)
 
+// log file formats, see CLog::Init()
+#define LOG_FORMAT_TEXT   0 // name.log, one line of text per record
+#define LOG_FORMAT_BINARY 1 // name.clog, see BinaryLog.h, turned into text with clog-decode
+#define LOG_FORMAT_SHARED 2 // name.log as text, appended to by several processes at once
+
+// when records get to the system and to the disk, see CLog::SetDurability()
+#define LOG_DURABILITY_FLUSH    0 // every record is handed to the system when it is logged (the default)
+#define LOG_DURABILITY_BUFFERED 1 // records are written in large blocks, the last ones are lost if the process crashes
+#define LOG_DURABILITY_PERIODIC 2 // buffered, and flushed and synced to disk when logging after periodMs passed
+
+#include "BinaryLog.h"
+#include "LogIndex.h"
+#include "StringBuilder.h"
 #include "GlobalsHandling.h"
 #include "utils/params_check_macros.h"
 
 #if defined(__gnu_linux__) || defined(__ANDROID__)
+#if defined(LOG_SHM_RING)
+#include "ShmInterfaceForCLog.h"
+typedef class CShmInterfaceForCLog PlatformInterfaceForCLog;
+#else
 #include "PosixInterfaceForCLog.h"
 typedef class CPosixInterfaceForCLog PlatformInterfaceForCLog;
-typedef pthread_t ThreadIdentifier;
-
-static pthread_mutexattr_t recursiveAttr;
+#endif
 
-static bool setRecursiveAttr() 
+/**
+ * Non-recursive lock for the short log critical sections: spins a bounded
+ * number of times while the owner is likely still running, then parks in
+ * the kernel on a futex. States: 0 unlocked, 1 locked, 2 locked and there
+ * may be waiters (so unlock has to wake one). See Drepper, "Futexes Are Tricky".
+ */
+class AdaptiveMutex
 {
-    static bool alreadyCalled = false; // initialized to 0 in the data segment prior to startup init code running
-    if (!alreadyCalled)
+    std::atomic<int> state;
+
+    enum { SPIN_COUNT = 100 };
+
+    static inline void cpuRelax()
     {
-        pthread_mutexattr_init(&recursiveAttr);
-        pthread_mutexattr_settype(&recursiveAttr,PTHREAD_MUTEX_RECURSIVE);
-        alreadyCalled = true;
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
     }
-    return true; // note, we never call destroy.
-}
 
-static bool recursiveAttrSet = setRecursiveAttr();
+    inline void futexWait(int expected) { syscall(SYS_futex, (int*)&state, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0); }
+    inline void futexWakeOne() { syscall(SYS_futex, (int*)&state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0); }
 
-class RecursiveMutex
-{
-    pthread_mutexattr_t* getRecursiveAttr()
+    void lockSlow()
     {
-        if (!recursiveAttrSet) // this is only possible in the single threaded startup code
-            recursiveAttrSet = setRecursiveAttr();
-        return &recursiveAttr;
+        for (int i = 0; i < SPIN_COUNT; i++)
+        {
+            int c = 0;
+            if (state.load(std::memory_order_relaxed) == 0 &&
+                state.compare_exchange_weak(c, 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            cpuRelax();
+        }
+        // mark as contended, and sleep until the state changes while it still is
+        while (state.exchange(2, std::memory_order_acquire) != 0)
+            futexWait(2);
     }
-    pthread_mutex_t mutex;
 public:
-    inline RecursiveMutex() { pthread_mutex_init(&mutex,getRecursiveAttr()); }
-
-    inline ~RecursiveMutex() { pthread_mutex_destroy(&mutex); }
+    inline AdaptiveMutex() : state(0) {}
 
-    inline void lock() { pthread_mutex_lock(&mutex); }
+    inline void lock()
+    {
+        int c = 0;
+        if (!state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed))
+            lockSlow();
+    }
 
-    inline void unlock() { pthread_mutex_unlock(&mutex); }
+    inline void unlock()
+    {
+        if (state.exchange(0, std::memory_order_release) == 2)
+            futexWakeOne();
+    }
 
-    inline bool try_lock() { return (pthread_mutex_trylock(&mutex) == 0); }
+    inline bool try_lock()
+    {
+        int c = 0;
+        return state.compare_exchange_strong(c, 1, std::memory_order_acquire, std::memory_order_relaxed);
+    }
 };
 
 
 #elif defined(WIN32)
 #include "Win32InterfaceForCLog.h"
 typedef class CWin32InterfaceForCLog PlatformInterfaceForCLog;
-typedef unsigned long ThreadIdentifier;
 
-class RecursiveMutex
+/**
+ * Non-recursive lock for the short log critical sections. A slim
+ * reader/writer lock used exclusively already spins briefly before it
+ * waits on a keyed event, and it needs no initialization or cleanup.
+ */
+class AdaptiveMutex
 {
-    CRITICAL_SECTION mutex;
+    SRWLOCK mutex;
 public:
-    inline RecursiveMutex()
+    inline AdaptiveMutex()
     {
-        InitializeCriticalSection(&mutex);
-    }
-
-    inline ~RecursiveMutex()
-    {
-        DeleteCriticalSection(&mutex);
+        InitializeSRWLock(&mutex);
     }
 
     inline void lock()
     {
-        EnterCriticalSection(&mutex);
+        AcquireSRWLockExclusive(&mutex);
     }
 
     inline void unlock()
     {
-        LeaveCriticalSection(&mutex);
+        ReleaseSRWLockExclusive(&mutex);
     }
 
     inline bool try_lock()
     {
-        return TryEnterCriticalSection(&mutex) ? true : false;
+        return TryAcquireSRWLockExclusive(&mutex) ? true : false;
     }
 };
 
@@ -125,95 +177,6 @@ public:
     inline NonCopyable() {}
   };
 
-    /**
-   * This template will take any implementation of the "Lockable" concept
-   * and allow it to be used as an "Exitable Lockable."
-   *
-   * Something that implements the "Lockable concept" simply means that 
-   * it has the three methods:
-   *
-   *   lock();
-   *   try_lock();
-   *   unlock();
-   *
-   * "Exitable" specifially means that, no matter how deep the recursion
-   * on the mutex/critical section, we can exit from it and then restore
-   * the state.
-   *
-   * This requires us to extend the Lockable so that we can keep track of the
-   * number of locks that have been recursively acquired so that we can
-   * undo it, and then restore that (See class CSingleExit).
-   *
-   * All xbmc code expects Lockables to be recursive.
-   */
-  template<class L> class CountingLockable : public NonCopyable
-  {
-    friend class ConditionVariable;
-  protected:
-    L mutex;
-    unsigned int count;
-
-  public:
-    inline CountingLockable() : count(0) {}
-
-    // boost::thread Lockable concept
-    inline void lock() { mutex.lock(); count++;}
-    inline bool try_lock() { return mutex.try_lock() ? count++, true : false; }
-    inline void unlock() { count--; mutex.unlock();}
-
-    /**
-     * This implements the "exitable" behavior mentioned above.
-     *
-     * This can be used to ALMOST exit, but not quite, by passing
-     *  the number of locks to leave. This is used in the windows
-     *  ConditionVariable which requires that the lock be entered
-     *  only once, and so it backs out ALMOST all the way, but
-     *  leaves one still there.
-     */
-    inline unsigned int exit(unsigned int leave = 0) 
-    { 
-      // it's possibe we don't actually own the lock
-      // so we will try it.
-      unsigned int ret = 0;
-      if (try_lock())
-      {
-        if (leave < (count - 1))
-        {
-          ret = count - 1 - leave;  // The -1 is because we don't want 
-                                    //  to count the try_lock increment.
-          // We must NOT compare "count" in this loop since 
-          // as soon as the last unlock is called another thread
-          // can modify it.
-          for (unsigned int i = 0; i < ret; i++)
-            unlock();
-        }
-        unlock(); // undo the try_lock before returning
-      }
-
-      return ret; 
-    }
-
-    /**
-     * Restore a previous exit to the provided level.
-     */
-    inline void restore(unsigned int restoreCount)
-    {
-      for (unsigned int i = 0; i < restoreCount; i++) 
-        lock();
-    }
-
-    /**
-     * Some implementations (see pthreads) require access to the underlying 
-     *  CCriticalSection, which is also implementation specific. This 
-     *  provides access to it through the same method on the guard classes
-     *  UniqueLock, and SharedLock.
-     *
-     * There really should be no need for the users of the threading library
-     *  to call this method.
-     */
-    inline L& get_underlying() { return mutex; }
-  };
-
   /**
    * This template can be used to define the base implementation for any UniqueLock
    * (such as CSingleLock) that uses a Lockable as its mutex/critical section.
@@ -242,8 +205,238 @@ public:
     inline L& get_underlying() { return mutex; }
   };
 
-class CLogCriticalSection : public CountingLockable<RecursiveMutex> {};
+/**
+ * The log lock is not recursive: nothing may log (or otherwise take it again)
+ * while holding it.
+ */
+class CLogCriticalSection : public AdaptiveMutex, public NonCopyable {};
+
+struct CLogThreadInfo
+{
+  unsigned int index;      //!< small sequential number, 1 for the first thread that logs, 0 if not assigned yet
+  unsigned long long tid;  //!< kernel thread id, gettid() or GetCurrentThreadId()
+  unsigned int nameLength;
+  char name[16];           //!< see CLog::SetThreadName()
+  unsigned int nameVersion; //!< incremented on every SetThreadName()
+  const char *context;      //!< see CLogContext, "key=value key=value", not terminated
+  unsigned int contextLength;
+  unsigned int contextVersion; //!< incremented on every CLogContext push and pop
+};
+
+struct CLogTime
+{
+  int year, month, day, hour, minute, second;
+};
+
+/*! \brief When CLog starts dropping records, see CLog::SetOverloadPolicy(). */
+struct CLogOverloadPolicy
+{
+  unsigned int maxWaiting;           //!< callers waiting for the log lock, 0 to not look at it
+  unsigned int maxWriteMicroseconds; //!< average time the log lock is held per record, 0 to not look at it
+};
+
+struct CLogOverloadStats
+{
+  unsigned long long admitted;         //!< records that got to the log lock
+  unsigned long long dropped[LOGNONE]; //!< per level, records dropped because of overload
+  int shedBelow;                       //!< records below this level are being dropped right now, 0 if none
+  unsigned int writeMicroseconds;      //!< average time the log lock is held per record (measured with a policy set)
+};
+
 
+/*!
+ \brief A key=value pair shown on every record the calling thread logs while it is in scope,
+ "ERROR: [req=42 tenant=acme] message". The text is rendered once, when it is created, and
+ copied into each record's prefix (a binary log stores it once and refers to it).
+ Contexts are per thread and nest, they have to be destroyed in the reverse order of creation,
+ which scoped variables are:
+ \code
+ CLogContext request("req", requestId);
+ CLogContext tenant("tenant", tenantName);
+ \endcode
+ */
+class CLogContext : public NonCopyable
+{
+public:
+  CLogContext(const char* key, IN_OPT_STRING const char* value);
+  CLogContext(const char* key, const std::string& value);
+  template<typename T>
+  CLogContext(const char* key, T value, typename std::enable_if<std::is_integral<T>::value>::type* = NULL)
+  {
+    Push(key, (typename std::conditional<std::is_signed<T>::value, long long, unsigned long long>::type)value);
+  }
+  ~CLogContext();
+
+private:
+  void Push(const char* key, long long value);
+  void Push(const char* key, unsigned long long value);
+  void Push(const char* key, const char* value, size_t length);
+
+  size_t m_previousLength;
+};
+
+/*!
+ \brief One log: its file, level, lock and state. The default one is behind the static
+ CLog functions, more can be created for subsystems that want their own file (an audit
+ or access log) without contending for the lock of the main log.
+ The functions can be called from any thread. Thread indexes and names (CLog::SetThreadName())
+ are per process, the same in every log.
+ */
+class CLogger : public NonCopyable
+{
+public:
+  CLogger();
+  ~CLogger();
+  /*! \brief Open the log file, path/name.log (or name.clog in binary format), the previous one is kept as name.old.log.
+   \param format LOG_FORMAT_TEXT or LOG_FORMAT_BINARY, or LOG_FORMAT_SHARED for a text log that forked or
+          unrelated processes append to together: the file is not rotated and has no index, every record is
+          written with one system call and tagged with "pid=<pid>" (shown like a CLogContext), and records
+          longer than PIPE_BUF are split into records of the same prefix whose text starts with "(continued) ".
+          Buffering durability modes don't apply to it.
+   */
+  bool Init(const char* path, const char* name, int format = LOG_FORMAT_TEXT);
+  void Close();
+  void Log(int loglevel, PRINTF_FORMAT_STRING const char *format, ...) PARAM3_PRINTF_FORMAT;
+  void LogV(int loglevel, const char *format, va_list args);
+  void LogFunction(int loglevel, IN_OPT_STRING const char* functionName, PRINTF_FORMAT_STRING const char* format, ...) PARAM4_PRINTF_FORMAT;
+  void MemDump(const char *pData, int length);
+  /*! \brief Log a hex dump as one multi-line LOGDEBUG record.
+   \param width bytes per row, 0 for the default of 16
+   \param offsetBase added to the offsets shown, e.g. the position of pData in a larger buffer
+   \param maxBytes if not 0, dump only the first maxBytes bytes and note how many were left out
+   */
+  void MemDump(const char *pData, size_t length, unsigned int width, uint64_t offsetBase = 0, size_t maxBytes = 0);
+  void SetLogLevel(int level);
+  int  GetLogLevel() const;
+  void SetExtraLogLevels(int level);
+  bool IsLogLevelLogged(int loglevel) const
+  {
+    const int extras = loglevel & ~LOGMASK;
+    return (extras == 0 || (m_extraLogLevels & extras) != 0) && (loglevel & LOGMASK) >= m_lowestLogged;
+  }
+  /*! \brief Whether a Log() call of the level does anything: the record is written, or kept by SetBacktrace().
+   The log_*() and logger_*() macros check it before evaluating their arguments, a filtered call costs this test.
+   */
+  bool IsLogLevelKept(int loglevel) const { return IsLogLevelLogged(loglevel) || m_backtraceRecords != 0; }
+  /*! \brief Log the text message() returns, a std::string or a const char*, for messages that are
+   expensive to build: message is only called if the record is written, after the level and the
+   overload policy (SetOverloadPolicy()) admitted it.
+   \code
+   logger.LogLazy(LOGDEBUG, [&] { return request.Dump(); });
+   \endcode
+   */
+  template<typename F>
+  void LogLazy(int loglevel, F&& message)
+  {
+    if (IsLogLevelLogged(loglevel) && Admit(loglevel))
+      LogString(loglevel, std::forward<F>(message)());
+  }
+  /*! \brief How densely Init() indexes a text log by time, in name.log.idx (see LogIndex.h).
+   Takes effect on the next Init(). The default is an entry every second or every 256 KB.
+   \param seconds index a record if this many seconds passed since the last indexed one, 0 for no time limit
+   \param kilobytes index a record if this much was written since the last indexed one, 0 for no size limit
+   Both 0 writes no index.
+   */
+  void SetLogIndex(unsigned int seconds, unsigned int kilobytes);
+  /*! \brief Drop the less important records while the log can't keep up (e.g. a slow disk),
+   instead of making every caller wait for it.
+   At a threshold DEBUG and INFO records are dropped, at twice the threshold NOTICE too;
+   WARNING and above are always written. Dropping stops when both measures are below half
+   their thresholds again for a while, then the number of dropped messages is logged. One in 1024 records that
+   would be dropped is still written, so the controller keeps measuring.
+   Both thresholds 0 (the default) turns the controller off.
+   */
+  void SetOverloadPolicy(const CLogOverloadPolicy& policy);
+  /*! \brief Trade throughput for crash durability.
+   There is no background thread, the periodic flush happens in the next Log() call after periodMs,
+   so in the buffered modes the last records can stay in memory for as long as nothing is logged.
+   Call it before Init() for the larger buffer of the buffered modes to be used.
+   \param mode LOG_DURABILITY_FLUSH, LOG_DURABILITY_BUFFERED or LOG_DURABILITY_PERIODIC
+   \param periodMs for LOG_DURABILITY_PERIODIC
+   \param syncLevel records of this level and above are on disk (fdatasync) before Log() returns,
+          in any mode; LOGNONE for none
+   */
+  void SetDurability(int mode, unsigned int periodMs = 1000, int syncLevel = LOGFATAL);
+  void GetOverloadStats(CLogOverloadStats& stats);
+  /*! \brief Keep the Log() calls that are below the log level, so a production log still shows
+   what led up to an error. Each thread keeps its last records unformatted (the arguments are
+   copied, see CBinaryLogWriter::AppendArguments()), they are formatted and written just before
+   the next record of triggerLevel or above the same thread logs, with the time they were logged at
+   (in a binary log, the time they are written at).
+   LogFunction(), LogLazy() and MemDump() calls below the log level are not kept.
+   \param records per thread, the ring is shared by the logs that use it on that thread and has
+          the size the largest of them asks for; 0 (the default) turns it off
+   \param triggerLevel records of this level and above write the kept ones
+   */
+  void SetBacktrace(unsigned int records, int triggerLevel = LOGERROR);
+
+protected:
+  friend class CLog;
+  friend class CLogSpan;
+  friend class CLogFormatProgram;
+  void LogFunctionV(int loglevel, const char* functionName, const char* format, va_list args);
+  void LogString(int logLevel, const std::string& logString);
+  void LogString(int logLevel, const char* message, size_t length);
+  void LogString(int logLevel, IN_OPT_STRING const char* message) { LogString(logLevel, message ? message : "", message ? strlen(message) : 0); }
+  /*! \brief Write one record, collapsing repeats, under the lock. time is NULL for now. */
+  void WriteRecord(int logLevel, const char* message, size_t length, const CLogTime* time);
+  bool WriteLogString(int logLevel, const std::string& logString, bool withContext, const CLogTime* time = NULL);
+  void CaptureBacktrace(int loglevel, const char* format, va_list args);
+  void WriteBacktrace();
+  void LogBinary(int logLevel, const char* format, va_list args);
+  /*! \brief false if the record is to be dropped because the log is overloaded. */
+  bool Admit(int loglevel);
+  unsigned long long UpdateOverload(unsigned int waiting, unsigned int writeMicroseconds);
+  class CWriteLock;
+  /*! \brief Write a record too long for one atomic append as several, for LOG_FORMAT_SHARED. */
+  bool WriteSharedPieces(int logLevel, const CLogTime& time, const CLogThreadInfo& thread, const char* context, size_t contextLength,
+                         const char* message, size_t length);
+  /*! \brief pthread_atfork() handlers of every CLogger: the forking thread holds all log locks
+   (and those of the record pool and the span trace) over fork(), the child resets them and what it inherited from the other threads. */
+  static void BeforeFork();
+  static void AfterForkInParent();
+  static void AfterForkInChild();
+  /*! \brief Identity of the calling thread, looked up once per thread. */
+  static const CLogThreadInfo& GetThreadInfo();
+
+  PlatformInterfaceForCLog m_platform;
+  int         m_repeatCount;
+  int         m_repeatLogLevel;
+  std::string m_repeatLine;
+  std::string m_repeatContext;
+  int         m_logLevel;
+  int         m_lowestLogged;   // the lowest level m_logLevel writes, see IsLogLevelLogged()
+  int         m_extraLogLevels;
+  unsigned int m_lastThreadIndex;
+  CLogCriticalSection   critSec;
+  bool        m_binary;
+  bool        m_shared;         // LOG_FORMAT_SHARED
+  std::string m_processContext; // "pid=<pid>" for a shared log
+  std::string m_sharedContext;  // reused buffer, m_processContext and the thread's context
+  CBinaryLogWriter m_binaryWriter;
+  std::string m_binaryRecord; // reused buffer for the encoded record
+  CStringBuilder m_record;    // reused buffer for the text record
+  CLogIndexWriter m_index;
+  unsigned int m_indexSeconds;
+  unsigned int m_indexKilobytes;
+  int         m_syncLevel;
+  unsigned int m_backtraceRecords;
+  int         m_backtraceLevel;
+  // overload control
+  CLogOverloadPolicy m_overloadPolicy;
+  std::atomic<bool> m_overloadEnabled; // read without the lock
+  std::atomic<int> m_shedBelow;
+  std::atomic<unsigned int> m_waiting;   // callers waiting for the lock, counted with a policy set
+  std::atomic<unsigned int> m_probe;     // lets one in 1024 shed records through
+  std::atomic<unsigned long long> m_dropped[LOGNONE];
+  unsigned long long m_admitted;         // these under the lock
+  int         m_shedStage;
+  unsigned int m_relievedWrites;
+  unsigned int m_writeMicroseconds;
+  unsigned long long m_droppedReported;
+};
+
+/*! \brief The static interface to the default CLogger, see there for the functions. */
 class CLog
 {
 public:
@@ -254,11 +447,31 @@ public:
   static void LogFunction(int loglevel, IN_OPT_STRING const char* functionName, PRINTF_FORMAT_STRING const char* format, ...) PARAM3_PRINTF_FORMAT;
 #define LogF(loglevel,format,...) LogFunction((loglevel),__FUNCTION__,(format),##__VA_ARGS__)
   static void MemDump(const char *pData, int length);
-  static bool Init(const char* path, const char* name);
+  static void MemDump(const char *pData, size_t length, unsigned int width, uint64_t offsetBase = 0, size_t maxBytes = 0);
+  static bool Init(const char* path, const char* name, int format = LOG_FORMAT_TEXT);
   static void SetLogLevel(int level);
   static int  GetLogLevel();
   static void SetExtraLogLevels(int level);
   static bool IsLogLevelLogged(int loglevel);
+  static bool IsLogLevelKept(int loglevel) { return GetLogger().IsLogLevelKept(loglevel); }
+  template<typename F>
+  static void LogLazy(int loglevel, F&& message) { GetLogger().LogLazy(loglevel, std::forward<F>(message)); }
+  /*! \brief Name the calling thread in its records, "T:12 io-worker" instead of "T:12".
+   The name is stored once per thread and used by every CLogger, names longer than 15 characters are cut.
+   The index to kernel thread id mapping is logged (LOGINFO) to the default log when a thread is named.
+   \param name the name, NULL or empty to remove it
+   */
+  static void SetThreadName(IN_OPT_STRING const char* name);
+  static void SetLogIndex(unsigned int seconds, unsigned int kilobytes);
+  static void SetOverloadPolicy(const CLogOverloadPolicy& policy);
+  static void SetDurability(int mode, unsigned int periodMs = 1000, int syncLevel = LOGFATAL);
+  static void GetOverloadStats(CLogOverloadStats& stats);
+  static void SetBacktrace(unsigned int records, int triggerLevel = LOGERROR);
+  /*! \brief The default log, to pass where a CLogger is expected. */
+  static CLogger& GetLogger() { return XBMC_GLOBAL_USE(CLog).m_globalInstance; }
+  /*! \brief Append the text record WriteLogString() writes (without the line end), also used by the binary log decoder. */
+  static void FormatRecord(CStringBuilder& record, const CLogTime& time, unsigned int threadIndex, const char* threadName, size_t threadNameLength,
+                           int logLevel, const char* context, size_t contextLength, const char* message, size_t length);
 
 #ifdef WIN32
   static std::string GBKToUTF8(const char* strGBK);
@@ -266,26 +479,13 @@ public:
 #endif  //WIN32
 
 protected:
-  class CLogGlobals
-  {
-  public:
-    CLogGlobals(void) : m_repeatCount(0), m_repeatLogLevel(-1), m_logLevel(LOG_LEVEL_DEBUG), m_extraLogLevels(0), m_lastThreadId(0) {}
-    ~CLogGlobals() {}
-    PlatformInterfaceForCLog m_platform;
-    int         m_repeatCount;
-    int         m_repeatLogLevel;
-    std::string m_repeatLine;
-    int         m_logLevel;
-    int         m_extraLogLevels;
-    unsigned long long m_lastThreadId;
-    CLogCriticalSection   critSec;
-  };
-  class CLogGlobals m_globalInstance; // used as static global variable
-  static void LogString(int logLevel, const std::string& logString);
-  static bool WriteLogString(int logLevel, const std::string& logString);
-  static ThreadIdentifier GetCurrentThreadId();
+  CLogger m_globalInstance; // used as static global variable
 };     
 
+// every file that can log keeps the logger alive, so it can be used from static constructors and destructors
+XBMC_GLOBAL_REF(CLog, g_log);
+
+// log_debug() ... log to the default log, logger_debug(logger, ...) ... to a CLogger
 #ifdef DISABLE_LOGGING
 #define log_debug(format, ...) 
 #define log_info(format, ...) 
@@ -294,29 +494,66 @@ protected:
 #define log_error(format, ...) 
 #define log_severe(format, ...) 
 #define log_fatal(format, ...)
+#define logger_debug(logger, format, ...)
+#define logger_info(logger, format, ...)
+#define logger_notice(logger, format, ...)
+#define logger_warning(logger, format, ...)
+#define logger_error(logger, format, ...)
+#define logger_severe(logger, format, ...)
+#define logger_fatal(logger, format, ...)
 #else
+// the arguments are only evaluated if the call does anything, see CLogger::IsLogLevelKept()
+#define CLOG_IF_KEPT(logger, loglevel, ...) \
+  do \
+  { \
+    CLogger& clogLogger_ = (logger); \
+    if (clogLogger_.IsLogLevelKept(loglevel)) \
+      clogLogger_.Log((loglevel), __VA_ARGS__); \
+  } while (0)
+
 #ifdef NDEBUG
-#define log_debug(format, ...)   CLog::Log(LOGDEBUG,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
-#define log_info(format, ...)    CLog::Log(LOGINFO,    "[%04d]" format, __LINE__, ##__VA_ARGS__)
-#define log_notice(format, ...)  CLog::Log(LOGNOTICE,  "[%04d]" format, __LINE__, ##__VA_ARGS__)
-#define log_warning(format, ...) CLog::Log(LOGWARNING, "[%04d]" format, __LINE__, ##__VA_ARGS__)
-#define log_error(format, ...)   CLog::Log(LOGERROR,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
-#define log_severe(format, ...)  CLog::Log(LOGSEVERE,  "[%04d]" format, __LINE__, ##__VA_ARGS__)
-#define log_fatal(format, ...)   CLog::Log(LOGFATAL,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define log_debug(format, ...)   CLOG_IF_KEPT(CLog::GetLogger(), LOGDEBUG,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define log_info(format, ...)    CLOG_IF_KEPT(CLog::GetLogger(), LOGINFO,    "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define log_notice(format, ...)  CLOG_IF_KEPT(CLog::GetLogger(), LOGNOTICE,  "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define log_warning(format, ...) CLOG_IF_KEPT(CLog::GetLogger(), LOGWARNING, "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define log_error(format, ...)   CLOG_IF_KEPT(CLog::GetLogger(), LOGERROR,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define log_severe(format, ...)  CLOG_IF_KEPT(CLog::GetLogger(), LOGSEVERE,  "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define log_fatal(format, ...)   CLOG_IF_KEPT(CLog::GetLogger(), LOGFATAL,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define logger_debug(logger, format, ...)   CLOG_IF_KEPT(logger, LOGDEBUG,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define logger_info(logger, format, ...)    CLOG_IF_KEPT(logger, LOGINFO,    "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define logger_notice(logger, format, ...)  CLOG_IF_KEPT(logger, LOGNOTICE,  "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define logger_warning(logger, format, ...) CLOG_IF_KEPT(logger, LOGWARNING, "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define logger_error(logger, format, ...)   CLOG_IF_KEPT(logger, LOGERROR,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define logger_severe(logger, format, ...)  CLOG_IF_KEPT(logger, LOGSEVERE,  "[%04d]" format, __LINE__, ##__VA_ARGS__)
+#define logger_fatal(logger, format, ...)   CLOG_IF_KEPT(logger, LOGFATAL,   "[%04d]" format, __LINE__, ##__VA_ARGS__)
 #else
 #define log_debug(format, ...) \
-    CLog::Log(LOGDEBUG, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+    CLOG_IF_KEPT(CLog::GetLogger(), LOGDEBUG, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
 #define log_info(format, ...) \
-    CLog::Log(LOGINFO, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+    CLOG_IF_KEPT(CLog::GetLogger(), LOGINFO, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
 #define log_notice(format, ...) \
-    CLog::Log(LOGNOTICE, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+    CLOG_IF_KEPT(CLog::GetLogger(), LOGNOTICE, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
 #define log_warning(format, ...) \
-    CLog::Log(LOGWARNING, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+    CLOG_IF_KEPT(CLog::GetLogger(), LOGWARNING, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
 #define log_error(format, ...) \
-    CLog::Log(LOGERROR, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+    CLOG_IF_KEPT(CLog::GetLogger(), LOGERROR, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
 #define log_severe(format, ...) \
-    CLog::Log(LOGSEVERE, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+    CLOG_IF_KEPT(CLog::GetLogger(), LOGSEVERE, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
 #define log_fatal(format, ...) \
-    CLog::Log(LOGFATAL, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+    CLOG_IF_KEPT(CLog::GetLogger(), LOGFATAL, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define logger_debug(logger, format, ...) \
+    CLOG_IF_KEPT(logger, LOGDEBUG, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define logger_info(logger, format, ...) \
+    CLOG_IF_KEPT(logger, LOGINFO, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define logger_notice(logger, format, ...) \
+    CLOG_IF_KEPT(logger, LOGNOTICE, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define logger_warning(logger, format, ...) \
+    CLOG_IF_KEPT(logger, LOGWARNING, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define logger_error(logger, format, ...) \
+    CLOG_IF_KEPT(logger, LOGERROR, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define logger_severe(logger, format, ...) \
+    CLOG_IF_KEPT(logger, LOGSEVERE, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
+#define logger_fatal(logger, format, ...) \
+    CLOG_IF_KEPT(logger, LOGFATAL, "[%s][%d]" format, __FILE__, __LINE__, ##__VA_ARGS__ )
 #endif //NDEBUG
 #endif //DISABLE_LOGGING